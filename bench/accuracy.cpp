@@ -0,0 +1,291 @@
+/*
+ * Accuracy against time of the quadtree approximation and of the solver
+ * variants. Every variant composites the same layers; the exact solve of
+ * the full-resolution mode (DCT) is the reference the 8-bit results are
+ * compared with. Prints one CSV row per variant: unknowns, wall time of
+ * run(), solve time, peak memory, PSNR, largest and mean error, and
+ * whether the variant is on the Pareto front of time against PSNR.
+ *
+ * Each variant runs in a child process of its own, so that its peak
+ * resident set size is its own; the memory column is that peak minus the
+ * size of the process when the child started.
+ *
+ *   g++ -O2 -fopenmp -I. bench/accuracy.cpp composite.cpp quadtree.cpp linear_quadtree.cpp \
+ *       image.cpp sparse_assembly.cpp solver.cpp linear_solver.cpp grid_laplacian.cpp \
+ *       grid_multigrid.cpp grid_poisson.cpp sparse_multigrid.cpp fft.cpp profile.cpp -o accuracy
+ *   ./accuracy (<directory> | --synthetic megapixels) [--variant mode:solver[:tolerance][:warm][:mixed] ...]
+ *       [--csv file]
+ *
+ * mode is quadtree or full, warm and mixed set the warm start and the mixed
+ * precision of the solver, e.g. --variant quadtree:amg-cg:1e-4 or
+ * --variant full:cg:1e-3:warm
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "composite.h"
+#include "child.h"
+#include "layer_stack.h"
+
+namespace
+{
+
+struct variant_t
+{
+	std::string label;
+	bool full;
+	solver_options_t options;
+};
+
+struct measure_t
+{
+	int width, height, unknowns;
+	double run, solve;
+	long memory;  // kilobytes
+};
+
+struct input_t
+{
+	std::string directory;  // empty for a generated stack
+	double megapixels = 0.0;
+};
+
+bool parse_variant(const std::string &text, variant_t &v)
+{
+	// mode, solver, then the tolerance, warm and mixed in any order
+	std::vector<std::string> fields;
+	for(size_t a = 0, b; ; a = b + 1)
+	{
+		b = text.find(':', a);
+		fields.push_back(text.substr(a, b - a));
+		if(b == std::string::npos)
+			break;
+	}
+	if(fields.size() < 2 || (fields[0] != "quadtree" && fields[0] != "full"))
+		return false;
+	v.label = text;
+	v.full = fields[0] == "full";
+	v.options = solver_options_t();
+	if(!parse_solver(fields[1].c_str(), v.options.solver))
+		return false;
+	for(size_t k = 2; k < fields.size(); ++k)
+	{
+		if(fields[k] == "warm")
+		{
+			v.options.warm_start = true;
+		} else if(fields[k] == "mixed") {
+			v.options.mixed_precision = true;
+		} else {
+			char *end;
+			v.options.tolerance = std::strtod(fields[k].c_str(), &end);
+			if(fields[k].empty() || *end)
+				return false;
+		}
+	}
+	return true;
+}
+
+void add_layers(image_compositor &compositor, const input_t &input)
+{
+	if(input.directory.empty())
+	{
+		int width = (int)std::sqrt(input.megapixels * 1e6 * 4.0 / 3.0);
+		add_stack(compositor, width, (int)(input.megapixels * 1e6 / width), stack_options_t());
+		return;
+	}
+
+	std::string prefix = input.directory + "/";
+	std::ifstream ifs(prefix + "layers.conf");
+	int offset_x, offset_y;
+	std::string image_name, mask_name;
+	while(ifs >> image_name >> mask_name >> offset_x >> offset_y)
+	{
+		auto mask_path = prefix + mask_name;
+		compositor.add_layer((prefix + image_name).c_str(),
+			mask_name == "NULL" ? nullptr : mask_path.c_str(), offset_x, offset_y);
+	}
+}
+
+// runs the variant in a child, which sends back its measures and result
+bool run_variant(const input_t &input, const variant_t &v, measure_t &m, std::vector<uint8_t> &result)
+{
+	int fds[2];
+	if(pipe(fds) != 0)
+		return false;
+	std::fflush(stdout);
+	pid_t pid = fork();
+	if(pid < 0)
+		return false;
+	if(pid == 0)
+	{
+		close(fds[0]);
+		long baseline = current_rss();
+		image_compositor compositor;
+		compositor.set_solver_options(v.options);
+		add_layers(compositor, input);
+		compositor.auto_image_size();
+		compositor.profile().clear();
+		compositor.run(v.full);
+
+		measure_t out = { };
+		for(const phase_record_t &p : compositor.profile().get_phases())
+		{
+			if(p.name == "run") out.run = p.wall;
+			if(p.name.compare(0, 6, "solve ") == 0) out.solve += p.wall;
+		}
+		for(const auto &c : compositor.profile().get_counters())
+		{
+			if(c.first == "width") out.width = c.second;
+			if(c.first == "height") out.height = c.second;
+			if(c.first == "unknowns") out.unknowns = c.second;
+		}
+		out.memory = peak_rss() - baseline;
+
+		std::shared_ptr<image_t> image = compositor.get_result();
+		bool ok = write_all(fds[1], &out, sizeof(out))
+			&& write_all(fds[1], image->buf, (size_t)out.width * out.height * 3);
+		std::fflush(stdout);
+		_exit(ok ? 0 : 1);
+	}
+
+	close(fds[1]);
+	bool ok = read_all(fds[0], &m, sizeof(m));
+	if(ok)
+	{
+		result.resize((size_t)m.width * m.height * 3);
+		ok = read_all(fds[0], result.data(), result.size());
+	}
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	input_t input;
+	std::vector<variant_t> variants;
+	const char *csv_path = nullptr;
+	for(int i = 1; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+		if(!std::strcmp(argv[i], "--synthetic") && has_value)
+		{
+			input.megapixels = std::atof(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--variant") && has_value) {
+			variant_t v;
+			if(!parse_variant(argv[++i], v))
+			{
+				std::fprintf(stderr, "bad variant %s, expected quadtree|full:solver[:tolerance][:warm][:mixed]\n", argv[i]);
+				return 1;
+			}
+			variants.push_back(v);
+		} else if(!std::strcmp(argv[i], "--csv") && has_value) {
+			csv_path = argv[++i];
+		} else if(argv[i][0] != '-' && input.directory.empty()) {
+			input.directory = argv[i];
+		} else {
+			input.directory.clear();
+			input.megapixels = 0.0;
+			break;
+		}
+	}
+	if(input.directory.empty() && input.megapixels <= 0.0)
+	{
+		std::fprintf(stderr, "usage: %s (<directory> | --synthetic megapixels)"
+			" [--variant quadtree|full:solver[:tolerance][:warm][:mixed] ...] [--csv file]\n", argv[0]);
+		return 1;
+	}
+
+	if(variants.empty())
+	{
+		const char *defaults[] = {
+			"quadtree:ldlt", "quadtree:amg-cg", "quadtree:amg-cg:1e-4", "quadtree:cg:1e-4",
+			"quadtree:cg:1e-4:warm", "quadtree:cg:1e-4:mixed", "full:mg-cg", "full:mg-cg:1e-4",
+			"full:cg:1e-3", "full:cg:1e-3:warm", "full:cg:1e-3:mixed", "full:dct",
+		};
+		for(const char *d : defaults)
+		{
+			variants.emplace_back();
+			parse_variant(d, variants.back());
+		}
+	}
+
+	// the exact solve is the reference
+	variant_t reference;
+	parse_variant("full:dct", reference);
+	measure_t reference_measure;
+	std::vector<uint8_t> expected;
+	if(!run_variant(input, reference, reference_measure, expected))
+	{
+		std::fprintf(stderr, "the reference run failed\n");
+		return 1;
+	}
+
+	struct row_t { variant_t v; measure_t m; double psnr, max_error, mean_error; bool ok; };
+	std::vector<row_t> rows;
+	for(const variant_t &v : variants)
+	{
+		row_t row = { v, { }, 0.0, 0.0, 0.0, false };
+		std::vector<uint8_t> result;
+		row.ok = run_variant(input, v, row.m, result) && result.size() == expected.size();
+		if(row.ok)
+		{
+			double squared = 0.0, total = 0.0;
+			int largest = 0;
+			for(size_t k = 0; k < result.size(); ++k)
+			{
+				int d = std::abs((int)result[k] - (int)expected[k]);
+				largest = std::max(largest, d);
+				squared += (double)d * d;
+				total += d;
+			}
+			double mse = squared / result.size();
+			row.psnr = mse == 0.0 ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / mse);
+			row.max_error = largest;
+			row.mean_error = total / result.size();
+		}
+		rows.push_back(row);
+	}
+
+	// on the front unless another variant is at least as fast and as
+	// accurate, and strictly better in one of the two
+	std::FILE *file = csv_path ? std::fopen(csv_path, "w") : stdout;
+	if(!file)
+	{
+		std::fprintf(stderr, "cannot write %s\n", csv_path);
+		return 1;
+	}
+	if(file == stdout)
+		std::puts("");
+	std::fprintf(file, "variant,mode,solver,tolerance,warm_start,mixed_precision,unknowns,run_s,solve_s,memory_kb,psnr_db,max_error,mean_error,pareto\n");
+	for(const row_t &r : rows)
+	{
+		if(!r.ok)
+		{
+			std::fprintf(file, "%s,%s,%s,%g,%d,%d,,,,,,,,\n", r.v.label.c_str(), r.v.full ? "full" : "quadtree",
+				solver_name(r.v.options.solver), r.v.options.tolerance, r.v.options.warm_start,
+				r.v.options.mixed_precision);
+			continue;
+		}
+		bool pareto = true;
+		for(const row_t &o : rows)
+			if(o.ok && o.m.run <= r.m.run && o.psnr >= r.psnr && (o.m.run < r.m.run || o.psnr > r.psnr))
+				pareto = false;
+		std::fprintf(file, "%s,%s,%s,%g,%d,%d,%d,%.6f,%.6f,%ld,%.3f,%g,%.6f,%d\n", r.v.label.c_str(),
+			r.v.full ? "full" : "quadtree", solver_name(r.v.options.solver), r.v.options.tolerance,
+			r.v.options.warm_start, r.v.options.mixed_precision, r.m.unknowns, r.m.run, r.m.solve, r.m.memory,
+			r.psnr, r.max_error, r.mean_error, pareto);
+	}
+	if(file != stdout)
+		std::fclose(file);
+	return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Thread scaling of the normal equation assembly (StS and StB) on the
+ * gradient rows of a multi-megapixel canvas whose layer map is noise,
+ * so that a large share of the rows sit on a seam. The serial std::map
+ * accumulation it replaced is timed once for reference.
+ *
+ *   g++ -O2 -fopenmp -I. bench/assembly_scaling.cpp sparse_assembly.cpp profile.cpp -o assembly_scaling
+ *   ./assembly_scaling [megapixels] [seam fraction]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+#include "sparse_assembly.h"
+#include "parallel.h"
+
+namespace
+{
+
+double elapsed(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	double megapixels = argc > 1 ? std::atof(argv[1]) : 4.0;
+	double seam = argc > 2 ? std::atof(argv[2]) : 0.3;
+	int side = std::sqrt(megapixels * 1e6);
+	int size = side * side;
+
+	// the rows of the full-resolution system: one per pixel pair and a pinned corner
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<sparse_row_t> S;
+	std::vector<double> B[3];
+	for(int i = 0; i < side; ++i)
+	{
+		for(int j = 0; j < side; ++j)
+		{
+			for(int axis = 0; axis < 2; ++axis)
+			{
+				int ti = i - axis, tj = j - (1 - axis);
+				if(ti < 0 || tj < 0) continue;
+				S.push_back( { { i * side + j, 1.0 }, { ti * side + tj, -1.0 } } );
+				bool on_seam = uniform(rng) < seam;
+				for(int ch = 0; ch < 3; ++ch)
+					B[ch].push_back(on_seam ? uniform(rng) * 255.0 - 128.0 : 0.0);
+			}
+		}
+	}
+	S.push_back( { { size - 1, 1.0 } } );
+	for(int ch = 0; ch < 3; ++ch)
+		B[ch].push_back(0.0);
+
+	std::printf("%dx%d canvas, %zu rows, %.0f%% on seams\n", side, side, S.size(), seam * 100);
+
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		std::map<std::pair<int, int>, double> M;
+		for(auto &line : S)
+			for(auto mv1 : line)
+				for(auto mv2 : line)
+					M[ std::make_pair(mv1.first, mv2.first) ] += mv1.second * mv2.second;
+		std::vector<Eigen::Triplet<double>> items;
+		for(auto it : M)
+			items.push_back( { it.first.first, it.first.second, it.second } );
+		Eigen::SparseMatrix<double> StS(size, size);
+		StS.setFromTriplets(items.begin(), items.end());
+		std::printf("std::map     StS %8.3fs  nnz %ld\n", elapsed(t0), (long)StS.nonZeros());
+	}
+
+	int max_threads = thread_count();
+	double base = 0.0;
+	std::printf("threads      StS        StB     speedup\n");
+	for(int threads = 1; threads <= max_threads; threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1)
+	{
+		set_thread_count(threads);
+		Eigen::SparseMatrix<double> StS;
+		block_t StB;
+
+		auto t0 = std::chrono::steady_clock::now();
+		assemble_normal_matrix(S, size, { }, StS);
+		double t_StS = elapsed(t0);
+
+		t0 = std::chrono::steady_clock::now();
+		assemble_normal_vectors(S, size, B, StB);
+		double t_StB = elapsed(t0);
+
+		if(threads == 1)
+			base = t_StS + t_StB;
+		std::printf("%7d %8.3fs  %8.3fs  %8.2fx\n", threads, t_StS, t_StB, base / (t_StS + t_StB));
+	}
+
+	return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef __BENCH_CHILD_H__
+#define __BENCH_CHILD_H__
+
+#include <cstddef>
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/*
+ * Helpers of the benches that measure each case in a child process of its
+ * own, so that the peak resident set size of a case is not that of an
+ * earlier, larger one. The child sends its results back through a pipe.
+ */
+
+// resident set size of this process now, in kilobytes
+inline long current_rss()
+{
+	long pages = 0, resident = 0;
+	if(std::FILE *file = std::fopen("/proc/self/statm", "r"))
+	{
+		if(std::fscanf(file, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		std::fclose(file);
+	}
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// peak resident set size of this process so far, in kilobytes
+inline long peak_rss()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+inline bool read_all(int fd, void *data, size_t size)
+{
+	char *p = (char*)data;
+	while(size > 0)
+	{
+		ssize_t n = read(fd, p, size);
+		if(n <= 0)
+			return false;
+		p += n, size -= n;
+	}
+	return true;
+}
+
+inline bool write_all(int fd, const void *data, size_t size)
+{
+	const char *p = (const char*)data;
+	while(size > 0)
+	{
+		ssize_t n = write(fd, p, size);
+		if(n <= 0)
+			return false;
+		p += n, size -= n;
+	}
+	return true;
+}
+
+#endif
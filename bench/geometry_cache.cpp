@@ -0,0 +1,83 @@
+/*
+ * Per-frame cost of compositing the same layer geometry again: the first
+ * run builds the quadtree, the matrices and the solver, every later run
+ * reloads the layers and only rebuilds StB and solves.
+ *
+ *   g++ -O2 -fopenmp -I. bench/geometry_cache.cpp composite.cpp quadtree.cpp linear_quadtree.cpp \
+ *       image.cpp sparse_assembly.cpp solver.cpp linear_solver.cpp grid_laplacian.cpp \
+ *       grid_multigrid.cpp grid_poisson.cpp sparse_multigrid.cpp fft.cpp profile.cpp -o geometry_cache
+ *   ./geometry_cache images/hand-eye [frames] [solver]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include "composite.h"
+
+namespace
+{
+
+double elapsed(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+void load_layers(image_compositor &compositor, const std::string &prefix)
+{
+	std::ifstream ifs(prefix + "layers.conf");
+	int offset_x, offset_y;
+	std::string image_name, mask_name;
+	while(ifs >> image_name >> mask_name >> offset_x >> offset_y)
+	{
+		auto mask_path = prefix + mask_name;
+		compositor.add_layer((prefix + image_name).c_str(),
+			mask_name == "NULL" ? nullptr : mask_path.c_str(), offset_x, offset_y);
+	}
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	if(argc < 2)
+	{
+		std::fprintf(stderr, "usage: %s <directory> [frames] [solver]\n", argv[0]);
+		return 1;
+	}
+
+	std::string prefix = std::string(argv[1]) + "/";
+	int frames = argc > 2 ? std::atoi(argv[2]) : 10;
+	solver_options_t options;
+	options.solver = solver_t::ldlt;
+	if(argc > 3 && !parse_solver(argv[3], options.solver))
+	{
+		std::fprintf(stderr, "unknown solver %s\n", argv[3]);
+		return 1;
+	}
+
+	image_compositor compositor;
+	compositor.set_solver_options(options);
+	load_layers(compositor, prefix);
+	compositor.auto_image_size();
+
+	auto t = std::chrono::steady_clock::now();
+	compositor.run();
+	double first = elapsed(t);
+
+	double total = 0.0;
+	for(int f = 0; f < frames; ++f)
+	{
+		compositor.clear_layers();
+		load_layers(compositor, prefix);
+		t = std::chrono::steady_clock::now();
+		compositor.run();
+		total += elapsed(t);
+	}
+
+	std::printf("\nsolver %s\n", solver_name(options.solver));
+	std::printf("first run        %8.2f ms\n", first * 1e3);
+	std::printf("cached run       %8.2f ms (mean of %d)\n", total / frames * 1e3, frames);
+	std::printf("speedup          %8.1fx\n", first / (total / frames));
+	return 0;
+}
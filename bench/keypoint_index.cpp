@@ -0,0 +1,140 @@
+/*
+ * Memory per keypoint and lookup throughput of keypoint_index_t against
+ * the std::map it replaced, with the lookup pattern of the interpolation
+ * lines: the pixel itself and the four corners of its leaf.
+ *
+ *   g++ -O2 -I. bench/keypoint_index.cpp quadtree.cpp linear_quadtree.cpp image.cpp -o keypoint_index
+ *   ./keypoint_index [scale ...]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <utility>
+#include <vector>
+#include "quadtree.h"
+#include "linear_quadtree.h"
+#include "keypoint_index.h"
+#include "image.h"
+#include "seam.h"
+
+namespace
+{
+
+size_t allocated_bytes = 0;
+
+// counts the heap footprint of the map, with every request rounded up to
+// a glibc malloc chunk (8 byte header, 16 byte granularity, 32 minimum)
+template<typename T>
+struct counting_allocator
+{
+	using value_type = T;
+	static size_t chunk(size_t bytes) { return std::max<size_t>(32, (bytes + 8 + 15) & ~(size_t)15); }
+	counting_allocator() = default;
+	template<typename U> counting_allocator(const counting_allocator<U>&) {}
+	T *allocate(size_t n)
+	{
+		allocated_bytes += chunk(n * sizeof(T));
+		return std::allocator<T>().allocate(n);
+	}
+	void deallocate(T *p, size_t n)
+	{
+		allocated_bytes -= chunk(n * sizeof(T));
+		std::allocator<T>().deallocate(p, n);
+	}
+	template<typename U> bool operator == (const counting_allocator<U>&) const { return true; }
+	template<typename U> bool operator != (const counting_allocator<U>&) const { return false; }
+};
+
+using point_t = std::pair<int, int>;
+using keypoint_map_t = std::map<point_t, int, std::less<point_t>,
+	counting_allocator<std::pair<const point_t, int>>>;
+
+double elapsed(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	image_t mask("images/hand-eye/test2_mask.png");
+
+	std::vector<int> scales;
+	for(int i = 1; i < argc; ++i)
+		scales.push_back(std::atoi(argv[i]));
+	if(scales.empty())
+		scales = { 1, 4, 16 };
+
+	for(int scale : scales)
+	{
+		seam_t seam = hand_eye_seam(mask, scale);
+		quadtree_t tree(0, seam.range, 0, seam.range);
+		tree.build(seam.points);
+		linear_quadtree_t ltree(tree);
+
+		std::vector<point_t> keypoints;
+		ltree.traverse([&](int xl, int, int yl, int) {
+			if(xl < seam.height && yl < seam.width && ltree.is_keypoint(xl, yl))
+				keypoints.emplace_back(xl, yl);
+		} );
+
+		std::vector<point_t> queries;
+		for(int i = 0; i < seam.height; ++i)
+		{
+			for(int j = 0; j < seam.width; ++j)
+			{
+				auto n = ltree.find(i, j);
+				queries.emplace_back(i, j);
+				queries.emplace_back(n->xl, n->yl);
+				queries.emplace_back(n->xl, n->yr);
+				queries.emplace_back(n->xr, n->yl);
+				queries.emplace_back(n->xr, n->yr);
+			}
+		}
+
+		std::printf("scale %d: %dx%d, %zu keypoints, %zu lookups\n",
+			scale, seam.height, seam.width, keypoints.size(), queries.size());
+
+		{
+			allocated_bytes = 0;
+			auto t0 = std::chrono::steady_clock::now();
+			keypoint_map_t index;
+			for(int i = 0; i < (int)keypoints.size(); ++i)
+				index[keypoints[i]] = i;
+			double build = elapsed(t0);
+			t0 = std::chrono::steady_clock::now();
+			long sum = 0;
+			for(auto q : queries)
+			{
+				auto it = index.find(q);
+				sum += it == index.end() ? -1 : it->second;
+			}
+			double lookup = elapsed(t0);
+			std::printf("  std::map  %6.1f bytes/keypoint  build %8.3fms  %7.1f Mlookups/s  (checksum %ld)\n",
+				allocated_bytes / (double)keypoints.size(), build * 1e3,
+				queries.size() / lookup * 1e-6, sum);
+		}
+
+		{
+			auto t0 = std::chrono::steady_clock::now();
+			keypoint_index_t index;
+			index.reserve(keypoints.size());
+			for(int i = 0; i < (int)keypoints.size(); ++i)
+				index.insert(keypoints[i].first, keypoints[i].second, i);
+			double build = elapsed(t0);
+			t0 = std::chrono::steady_clock::now();
+			long sum = 0;
+			for(auto q : queries)
+				sum += index.find(q.first, q.second);
+			double lookup = elapsed(t0);
+			std::printf("  flat hash %6.1f bytes/keypoint  build %8.3fms  %7.1f Mlookups/s  (checksum %ld)\n",
+				index.memory() / (double)keypoints.size(), build * 1e3,
+				queries.size() / lookup * 1e-6, sum);
+		}
+	}
+
+	return 0;
+}
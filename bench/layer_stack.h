@@ -0,0 +1,108 @@
+#ifndef __BENCH_LAYER_STACK_H__
+#define __BENCH_LAYER_STACK_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include "composite.h"
+#include "image.h"
+
+/*
+ * Generated layer stacks: a full-canvas background plus layers of pasted
+ * blobs. The blobs set the seam length, their rough outlines the mask
+ * complexity, and the layer size the overlap.
+ */
+struct stack_options_t
+{
+	int layers = 3;           // including the background
+	int blobs = 4;            // per pasted layer, more blobs are more seam
+	double roughness = 0.3;   // amplitude of the wiggles of a blob outline
+	double overlap = 0.25;    // area of a pasted layer over the canvas
+};
+
+// value noise in [0, 1) without any state, so the images do not depend on
+// the order they are generated in
+inline double hash_noise(uint32_t x, uint32_t y, uint32_t seed)
+{
+	uint32_t h = x * 0x9e3779b1u ^ y * 0x85ebca77u ^ seed * 0xc2b2ae3du;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	return (h & 0xffffff) / 16777216.0;
+}
+
+// a smooth colour field with a little grain, different for every seed
+inline std::shared_ptr<image_t> make_texture(int w, int h, uint32_t seed)
+{
+	auto image = std::make_shared<image_t>(w, h, 3);
+	double fx = 0.002 + 0.003 * hash_noise(seed, 1, 7), fy = 0.002 + 0.003 * hash_noise(seed, 2, 7);
+	double base[3];
+	for(int ch = 0; ch < 3; ++ch)
+		base[ch] = 70.0 + 110.0 * hash_noise(seed, ch, 11);
+	for(int i = 0; i < h; ++i)
+	{
+		uint8_t *row = image->buf + (size_t)i * w * 3;
+		double wave = 30.0 * std::sin(fx * i + seed);
+		for(int j = 0; j < w; ++j)
+		{
+			double v = wave + 30.0 * std::cos(fy * j + 2 * seed);
+			for(int ch = 0; ch < 3; ++ch)
+			{
+				double c = base[ch] + v + 16.0 * hash_noise(i, j * 3 + ch, seed);
+				row[3 * j + ch] = (uint8_t)std::max(0.0, std::min(255.0, c));
+			}
+		}
+	}
+	return image;
+}
+
+// star-shaped blobs r(t) = R (1 + roughness * sum_k sin(k t + phase_k) / k)
+inline std::unique_ptr<image_t> make_mask(int w, int h, int blobs, double roughness, std::mt19937 &rng)
+{
+	std::unique_ptr<image_t> mask(new image_t(w, h, 1));
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	const int harmonics = 6;
+	for(int b = 0; b < blobs; ++b)
+	{
+		double radius = std::min(w, h) * (0.12 + 0.2 * uniform(rng)) / std::sqrt((double)blobs);
+		double cx = h * (0.2 + 0.6 * uniform(rng)), cy = w * (0.2 + 0.6 * uniform(rng));
+		double phase[harmonics];
+		for(int k = 0; k < harmonics; ++k)
+			phase[k] = 2.0 * M_PI * uniform(rng);
+
+		double reach = radius * (1.0 + roughness * 2.5);
+		int xl = std::max(0, (int)(cx - reach)), xr = std::min(h, (int)(cx + reach) + 1);
+		int yl = std::max(0, (int)(cy - reach)), yr = std::min(w, (int)(cy + reach) + 1);
+		for(int i = xl; i < xr; ++i)
+		{
+			for(int j = yl; j < yr; ++j)
+			{
+				double dx = i - cx, dy = j - cy, t = std::atan2(dy, dx), r = radius;
+				for(int k = 1; k <= harmonics; ++k)
+					r += radius * roughness * std::sin(k * t + phase[k - 1]) / k;
+				if(dx * dx + dy * dy <= r * r)
+					mask->buf[(size_t)i * w + j] = 255;
+			}
+		}
+	}
+	return mask;
+}
+
+inline void add_stack(image_compositor &compositor, int width, int height, const stack_options_t &o)
+{
+	std::mt19937 rng(width * 31 + height);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	compositor.add_layer(make_texture(width, height, 1), nullptr);
+	double side = std::sqrt(std::min(1.0, std::max(0.01, o.overlap)));
+	int w = std::max(8, (int)(width * side)), h = std::max(8, (int)(height * side));
+	for(int l = 1; l < o.layers; ++l)
+	{
+		int ox = (int)((height - h) * uniform(rng)), oy = (int)((width - w) * uniform(rng));
+		std::unique_ptr<image_t> mask = make_mask(w, h, o.blobs, o.roughness, rng);
+		compositor.add_layer(make_texture(w, h, l + 1), mask.get(), ox, oy);
+	}
+}
+
+#endif
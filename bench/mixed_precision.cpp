@@ -0,0 +1,82 @@
+/*
+ * Mixed-precision cg against the all-double path on the full-resolution
+ * system of a square canvas, both matrix-free and with the stored matrix.
+ * The right-hand side comes from a smooth delta of 8-bit amplitude plus
+ * noise, the difference of the two solutions is given in 8-bit levels.
+ *
+ *   g++ -O2 -fopenmp -I. bench/mixed_precision.cpp solver.cpp linear_solver.cpp grid_laplacian.cpp \
+ *       grid_multigrid.cpp grid_poisson.cpp sparse_multigrid.cpp fft.cpp profile.cpp -o mixed_precision
+ *   ./mixed_precision [megapixels] [tolerance]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "grid_laplacian.h"
+#include "linear_solver.h"
+
+namespace
+{
+
+double elapsed(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+template<typename Make>
+block_t run(const char *label, const block_t &b, solver_options_t options, const Make &make)
+{
+	block_t x = block_t::Zero(b.rows(), 3);
+	auto t = std::chrono::steady_clock::now();
+	std::unique_ptr<linear_solver_t> solver = make(options);
+	double setup = elapsed(t);
+	t = std::chrono::steady_clock::now();
+	solver_stats_t stats = solver->solve(b, x);
+	double solve = elapsed(t);
+	std::printf("%-28s %8.3fs setup %8.3fs solve %6d iterations  error %.2e\n", label, setup, solve,
+		stats.iterations[0], stats.error[0]);
+	return x;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	double megapixels = argc > 1 ? std::atof(argv[1]) : 1.0;
+	double tolerance = argc > 2 ? std::atof(argv[2]) : 1.0e-8;
+	int side = std::sqrt(megapixels * 1e6);
+
+	grid_laplacian_t grid(side, side);
+	std::mt19937 rng(1);
+	std::normal_distribution<double> noise(0.0, 1.0);
+	block_t delta(grid.rows(), 3), b(grid.rows(), 3);
+	for(int i = 0; i < side; ++i)
+		for(int j = 0; j < side; ++j)
+			for(int ch = 0; ch < 3; ++ch)
+				delta(i * side + j, ch) = 40.0 * std::sin(0.01 * (ch + 1) * i) * std::cos(0.013 * j) + noise(rng);
+	grid.apply(delta, b);
+
+	Eigen::SparseMatrix<double> A = grid.to_sparse();
+	A.makeCompressed();
+	std::printf("%dx%d grid, tolerance %g\n", side, side, tolerance);
+
+	solver_options_t options;
+	options.solver = solver_t::cg;
+	options.tolerance = tolerance;
+	auto grid_solver = [&](const solver_options_t &o) { return make_grid_solver(side, side, o); };
+	auto sparse_solver = [&](const solver_options_t &o) { return make_solver(A, o); };
+	for(int stored = 0; stored < 2; ++stored)
+	{
+		block_t x[2];
+		for(int mixed = 0; mixed < 2; ++mixed)
+		{
+			options.mixed_precision = mixed;
+			const char *label = stored ? (mixed ? "stored, mixed precision" : "stored, double")
+				: (mixed ? "matrix-free, mixed precision" : "matrix-free, double");
+			x[mixed] = stored ? run(label, b, options, sparse_solver) : run(label, b, options, grid_solver);
+		}
+		std::printf("%-28s %.3g levels\n", "largest difference", (x[1] - x[0]).cwiseAbs().maxCoeff());
+	}
+	return 0;
+}
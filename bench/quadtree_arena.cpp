@@ -0,0 +1,169 @@
+/*
+ * Build and teardown cost of the arena quadtree, split point by point or
+ * built in bulk, against the former pointer-based quadtree, on the
+ * hand-eye seam scaled up.
+ *
+ *   g++ -O2 -I. bench/quadtree_arena.cpp quadtree.cpp image.cpp -o quadtree_arena
+ *   ./quadtree_arena [scale ...]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+#include "quadtree.h"
+#include "image.h"
+#include "seam.h"
+
+namespace
+{
+
+// the quadtree as it was before the node arena: one heap allocation per node
+class pointer_quadtree_t
+{
+	int range;
+	int xl, xr, yl, yr;
+	pointer_quadtree_t *s_ll, *s_lr, *s_rl, *s_rr;
+
+	bool is_leaf() { return s_ll == nullptr; }
+	bool in_range(int x, int y) { return x >= xl && y >= yl && x < xr && y < yr; }
+
+	pointer_quadtree_t *_find_child(int x, int y)
+	{
+		int xm = (xl + xr) >> 1, ym = (yl + yr) >> 1;
+		if(x < xm) return y < ym ? s_ll : s_lr;
+		else return y < ym ? s_rl : s_rr;
+	}
+
+	void _split()
+	{
+		int xm = (xl + xr) >> 1, ym = (yl + yr) >> 1;
+		s_ll = new pointer_quadtree_t(xl, xm, yl, ym);
+		s_lr = new pointer_quadtree_t(xl, xm, ym, yr);
+		s_rl = new pointer_quadtree_t(xm, xr, yl, ym);
+		s_rr = new pointer_quadtree_t(xm, xr, ym, yr);
+	}
+
+	static void _split_tree(pointer_quadtree_t *root, int x, int y, int range)
+	{
+		auto sub_split = [=](int x, int y, int range) {
+			pointer_quadtree_t *n = root->find(x, y);
+			if(n && n->range > range)
+				_split_tree(root, x, y, range);
+		};
+		pointer_quadtree_t *now = root;
+		while(now->range > range)
+		{
+			if(now->is_leaf())
+			{
+				now->_split();
+				sub_split(now->xl - 1, now->yl, now->range);
+				sub_split(now->xl, now->yl - 1, now->range);
+				sub_split(now->xr, now->yl, now->range);
+				sub_split(now->xl, now->yr, now->range);
+			}
+
+			now = now->_find_child(x, y);
+		}
+	}
+
+public:
+	pointer_quadtree_t(int xl, int xr, int yl, int yr)
+		: range(xr - xl), xl(xl), xr(xr), yl(yl), yr(yr)
+	{
+		s_ll = s_lr = s_rl = s_rr = nullptr;
+	}
+
+	~pointer_quadtree_t()
+	{
+		if(!is_leaf())
+		{
+			delete s_ll;
+			delete s_lr;
+			delete s_rl;
+			delete s_rr;
+		}
+	}
+
+	int get_range() { return range; }
+
+	pointer_quadtree_t *find(int x, int y)
+	{
+		if(!in_range(x, y))
+			return nullptr;
+		if(is_leaf()) return this;
+		return _find_child(x, y)->find(x, y);
+	}
+
+	void split(int x, int y, int range = 1)
+	{
+		_split_tree(this, x, y, range);
+		if(x > xl && y > yl)
+			_split_tree(this, x - 1, y - 1, range);
+	}
+};
+
+double elapsed(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+template<typename Tree>
+void split_all(Tree *tree, const seam_t &seam)
+{
+	for(auto p : seam.points)
+		tree->split(p.first, p.second, 1);
+}
+
+void build_all(quadtree_t *tree, const seam_t &seam)
+{
+	tree->build(seam.points);
+}
+
+template<typename Tree, typename Build>
+void bench(const char *name, const seam_t &seam, Build build_tree)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	Tree *tree = new Tree(0, seam.range, 0, seam.range);
+	build_tree(tree, seam);
+	double build = elapsed(t0);
+
+	t0 = std::chrono::steady_clock::now();
+	long sum = 0;
+	for(int i = 0; i < seam.height; ++i)
+		for(int j = 0; j < seam.width; ++j)
+			sum += tree->find(i, j)->get_range();
+	double find = elapsed(t0);
+
+	t0 = std::chrono::steady_clock::now();
+	delete tree;
+	double destroy = elapsed(t0);
+
+	std::printf("  %-8s build %8.3fms  find %8.3fms  destroy %8.3fms  (checksum %ld)\n",
+		name, build * 1e3, find * 1e3, destroy * 1e3, sum);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	image_t mask("images/hand-eye/test2_mask.png");
+
+	std::vector<int> scales;
+	for(int i = 1; i < argc; ++i)
+		scales.push_back(std::atoi(argv[i]));
+	if(scales.empty())
+		scales = { 1, 4, 16 };
+
+	for(int scale : scales)
+	{
+		seam_t seam = hand_eye_seam(mask, scale);
+		std::printf("scale %d: %dx%d, %zu split points\n",
+			scale, seam.height, seam.width, seam.points.size());
+		bench<pointer_quadtree_t>("pointer", seam, split_all<pointer_quadtree_t>);
+		bench<quadtree_t>("arena", seam, split_all<quadtree_t>);
+		bench<quadtree_t>("bulk", seam, build_all);
+	}
+
+	return 0;
+}
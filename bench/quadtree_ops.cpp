@@ -0,0 +1,127 @@
+/*
+ * The quadtree_t primitives under build_boundary and build_interp_line, on
+ * seams of different shapes: split point by point and bulk build, find,
+ * find_outer and is_keypoint on random pixels, traverse over all leaves,
+ * and the constructor from a boundary image, whose PNG decode is timed
+ * on its own. Lookups are averaged over `queries` random pixels.
+ *
+ *   g++ -O2 -I. bench/quadtree_ops.cpp quadtree.cpp image.cpp -o quadtree_ops
+ *   ./quadtree_ops [side] [queries] [boundary.png path to write]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+#include "quadtree.h"
+#include "image.h"
+#include "seam.h"
+
+namespace
+{
+
+double elapsed(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+// a row of the table, printed once image_t is done logging its loads and saves
+std::string bench(const char *shape, const seam_t &seam, const std::vector<std::pair<int, int>> &queries,
+	const char *boundary_path)
+{
+	// split point by point, then the bulk build the compositor uses
+	auto t = std::chrono::steady_clock::now();
+	quadtree_t split(0, seam.range, 0, seam.range);
+	for(auto p : seam.points)
+		split.split(p.first, p.second, 1);
+	double t_split = elapsed(t);
+
+	t = std::chrono::steady_clock::now();
+	quadtree_t tree(0, seam.range, 0, seam.range);
+	tree.build(seam.points);
+	double t_build = elapsed(t);
+
+	long long sum = 0;
+	t = std::chrono::steady_clock::now();
+	for(auto q : queries)
+		sum += tree.find(q.first, q.second)->get_range();
+	double t_find = elapsed(t);
+
+	t = std::chrono::steady_clock::now();
+	for(auto q : queries)
+		sum += tree.find_outer(q.first, q.second)->get_range();
+	double t_outer = elapsed(t);
+
+	t = std::chrono::steady_clock::now();
+	for(auto q : queries)
+		sum += tree.is_keypoint(q.first, q.second);
+	double t_keypoint = elapsed(t);
+
+	int leaves = 0;
+	t = std::chrono::steady_clock::now();
+	tree.traverse([&](int xl, int xr, int yl, int yr) {
+		++leaves;
+		sum += xr - xl + yr - yl;
+	} );
+	double t_traverse = elapsed(t);
+
+	// the boundary image has the canvas size, boundary pixels are black
+	image_t boundary(seam.width, seam.height, 1);
+	std::memset(boundary.buf, 255, (size_t)seam.width * seam.height);
+	for(auto p : seam.points)
+		boundary.buf[(size_t)p.first * seam.width + p.second] = 0;
+	boundary.write(boundary_path);
+	t = std::chrono::steady_clock::now();
+	{
+		image_t decoded(boundary_path);
+		sum += decoded.buf[0];
+	}
+	double t_decode = elapsed(t);
+	t = std::chrono::steady_clock::now();
+	quadtree_t from_file(boundary_path);
+	double t_file = elapsed(t);
+	sum += from_file.node_count();
+
+	double n = queries.size();
+	char row[256];
+	std::snprintf(row, sizeof(row), "%-8s %9zu %9d %10.2f %10.2f %8.1f %8.1f %8.1f %10.2f %10.2f %10.2f  %lld\n",
+		shape, seam.points.size(), leaves, seam.points.size() / t_split / 1e6, seam.points.size() / t_build / 1e6,
+		t_find / n * 1e9, t_outer / n * 1e9, t_keypoint / n * 1e9, t_traverse * 1e3, t_decode * 1e3,
+		(t_file - t_decode) * 1e3, sum);
+	return row;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	int side = argc > 1 ? std::atoi(argv[1]) : 2048;
+	int count = argc > 2 ? std::atoi(argv[2]) : 1 << 22;
+	const char *boundary_path = argc > 3 ? argv[3] : "quadtree_ops_boundary.png";
+
+	std::vector<std::pair<int, int>> queries;
+	unsigned seed = 12345;
+	for(int k = 0; k < count; ++k)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		int x = (seed >> 8) % side;
+		seed = seed * 1664525u + 1013904223u;
+		queries.emplace_back(x, (seed >> 8) % side);
+	}
+
+	std::vector<std::string> rows = {
+		bench("lines", line_seam(side, 16), queries, boundary_path),
+		bench("circles", circle_seam(side, 16), queries, boundary_path),
+		bench("noise", noise_seam(side, 0.001), queries, boundary_path),
+		bench("dense", noise_seam(side, 0.05), queries, boundary_path),
+	};
+	std::remove(boundary_path);
+
+	std::printf("\n%dx%d canvas, %d lookups\n", side, side, count);
+	std::printf("%-8s %9s %9s %10s %10s %8s %8s %8s %10s %10s %10s  %s\n", "shape", "points", "leaves",
+		"split Mp/s", "build Mp/s", "find ns", "outer ns", "key ns", "trav ms", "decode ms", "file ms", "checksum");
+	for(const std::string &row : rows)
+		std::fputs(row.c_str(), stdout);
+	return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef __BENCH_SEAM_H__
+#define __BENCH_SEAM_H__
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "image.h"
+
+struct seam_t
+{
+	int width, height, range;
+	std::vector<std::pair<int, int>> points;
+};
+
+// boundary pixels of test2_mask.png pasted at (160, 140) on the 418x356
+// canvas of images/hand-eye, with everything scaled by `scale`
+inline seam_t hand_eye_seam(const image_t &mask, int scale)
+{
+	seam_t seam;
+	seam.width = 418 * scale;
+	seam.height = 356 * scale;
+	for(seam.range = 1; seam.range < std::max(seam.width, seam.height); seam.range <<= 1);
+
+	auto inside = [&](int x, int y) {
+		x = x / scale - 160;
+		y = y / scale - 140;
+		if(x < 0 || y < 0 || x >= mask.h || y >= mask.w)
+			return false;
+		return mask.buf[(x * mask.w + y) * mask.c] > 128;
+	};
+
+	for(int i = 0; i < seam.width; ++i)
+		seam.points.emplace_back(seam.height - 1, i);
+	for(int i = 0; i < seam.height; ++i)
+		seam.points.emplace_back(i, seam.width - 1);
+	for(int i = 0; i < seam.height; ++i)
+	{
+		for(int j = 0; j < seam.width; ++j)
+		{
+			bool z = inside(i, j);
+			if((i > 0 && inside(i - 1, j) != z) || (j > 0 && inside(i, j - 1) != z)
+				|| (i + 1 < seam.height && inside(i + 1, j) != z)
+				|| (j + 1 < seam.width && inside(i, j + 1) != z))
+				seam.points.emplace_back(i, j);
+		}
+	}
+
+	return seam;
+}
+
+// the border rows every seam of the compositor has, on a side x side canvas
+inline seam_t empty_seam(int side)
+{
+	seam_t seam;
+	seam.width = seam.height = side;
+	for(seam.range = 1; seam.range < side; seam.range <<= 1);
+	for(int i = 0; i < side; ++i)
+		seam.points.emplace_back(side - 1, i);
+	for(int i = 0; i + 1 < side; ++i)
+		seam.points.emplace_back(i, side - 1);
+	return seam;
+}
+
+// `count` horizontal, vertical and diagonal lines in turn
+inline seam_t line_seam(int side, int count)
+{
+	seam_t seam = empty_seam(side);
+	for(int k = 1; k <= count; ++k)
+	{
+		int at = (long long)side * k / (count + 1);
+		for(int i = 0; i < side; ++i)
+		{
+			if(k % 3 == 0) seam.points.emplace_back(i, (at + i) % side);
+			else if(k % 3 == 1) seam.points.emplace_back(at, i);
+			else seam.points.emplace_back(i, at);
+		}
+	}
+	return seam;
+}
+
+// `count` concentric circles around the centre
+inline seam_t circle_seam(int side, int count)
+{
+	seam_t seam = empty_seam(side);
+	double c = side / 2.0;
+	for(int k = 1; k <= count; ++k)
+	{
+		double r = c * k / (count + 1);
+		int steps = (int)(8 * r) + 8;
+		for(int s = 0; s < steps; ++s)
+		{
+			double t = 2.0 * M_PI * s / steps;
+			seam.points.emplace_back((int)(c + r * std::cos(t)), (int)(c + r * std::sin(t)));
+		}
+	}
+	return seam;
+}
+
+// a fraction `density` of all pixels, scattered uniformly
+inline seam_t noise_seam(int side, double density, unsigned seed = 1)
+{
+	seam_t seam = empty_seam(side);
+	long long count = (long long)(density * side * side);
+	for(long long k = 0; k < count; ++k)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		int x = (seed >> 8) % side;
+		seed = seed * 1664525u + 1013904223u;
+		int y = (seed >> 8) % side;
+		seam.points.emplace_back(x, y);
+	}
+	return seam;
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * Thread scaling of the conjugate gradient solve: a fixed number of
+ * iterations on the full-resolution system of a square canvas, once with
+ * the matrix-free Laplacian and once with its sparse matrix, and, given a
+ * layer directory, the cached quadtree run of the compositor with cg.
+ *
+ *   g++ -O2 -fopenmp -I. bench/solver_scaling.cpp composite.cpp quadtree.cpp linear_quadtree.cpp \
+ *       image.cpp sparse_assembly.cpp solver.cpp linear_solver.cpp grid_laplacian.cpp \
+ *       grid_multigrid.cpp grid_poisson.cpp sparse_multigrid.cpp fft.cpp profile.cpp -o solver_scaling
+ *   ./solver_scaling [megapixels] [iterations] [directory]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include "composite.h"
+#include "grid_laplacian.h"
+#include "parallel.h"
+#include "solver.h"
+
+namespace
+{
+
+double elapsed(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+template<typename Operator>
+double time_cg(const Operator &A, const block_t &b, int iterations)
+{
+	jacobi_preconditioner_t M(A.diagonal());
+	block_t x = block_t::Zero(A.rows(), 3);
+	auto t = std::chrono::steady_clock::now();
+	block_cg(A, M, b, x, 0.0, iterations);
+	return elapsed(t);
+}
+
+void load_layers(image_compositor &compositor, const std::string &prefix)
+{
+	std::ifstream ifs(prefix + "layers.conf");
+	int offset_x, offset_y;
+	std::string image_name, mask_name;
+	while(ifs >> image_name >> mask_name >> offset_x >> offset_y)
+	{
+		auto mask_path = prefix + mask_name;
+		compositor.add_layer((prefix + image_name).c_str(),
+			mask_name == "NULL" ? nullptr : mask_path.c_str(), offset_x, offset_y);
+	}
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	double megapixels = argc > 1 ? std::atof(argv[1]) : 4.0;
+	int iterations = argc > 2 ? std::atoi(argv[2]) : 50;
+	int side = std::sqrt(megapixels * 1e6);
+
+	grid_laplacian_t grid(side, side);
+	Eigen::SparseMatrix<double> A = grid.to_sparse();
+	sparse_operator_t sparse(A);
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+	block_t b(grid.rows(), 3);
+	for(int i = 0; i < b.rows(); ++i)
+		b.row(i) << uniform(rng), uniform(rng), uniform(rng);
+
+	std::printf("%dx%d grid, %d cg iterations\n", side, side, iterations);
+	std::printf("threads   matrix-free      sparse   speedup\n");
+	int max_threads = thread_count();
+	double base = 0.0;
+	for(int threads = 1; threads <= max_threads; threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1)
+	{
+		set_thread_count(threads);
+		double t_grid = time_cg(grid, b, iterations);
+		double t_sparse = time_cg(sparse, b, iterations);
+		if(threads == 1)
+			base = t_sparse;
+		std::printf("%7d %12.3fs %10.3fs %8.2fx\n", threads, t_grid, t_sparse, base / t_sparse);
+	}
+
+	if(argc > 3)
+	{
+		std::string prefix = std::string(argv[3]) + "/";
+		solver_options_t options;
+		options.solver = solver_t::cg;
+		image_compositor compositor;
+		compositor.set_solver_options(options);
+		load_layers(compositor, prefix);
+		compositor.auto_image_size();
+		compositor.run();
+
+		// the geometry stays cached, every run is StB and the solve
+		double times[64];
+		int count = 0;
+		for(int threads = 1; threads <= max_threads && count < 64; threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1)
+		{
+			set_thread_count(threads);
+			compositor.clear_layers();
+			load_layers(compositor, prefix);
+			auto t = std::chrono::steady_clock::now();
+			compositor.run();
+			times[count++] = elapsed(t);
+		}
+
+		std::printf("\nquadtree system of %s, cached runs with cg\n", argv[3]);
+		std::printf("threads        run   speedup\n");
+		for(int i = 0, threads = 1; i < count; ++i, threads = threads < max_threads ? std::min(threads * 2, max_threads) : threads + 1)
+			std::printf("%7d %9.3fs %8.2fx\n", threads, times[i], times[0] / times[i]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * Scaling of the compositor on generated layer stacks. Every stack is a
+ * full-canvas background plus layers of pasted blobs; the blobs set the
+ * seam length, their rough outlines the mask complexity, and the layer
+ * size the overlap. Each size runs all the phases of image_compositor::run
+ * and is reported as a table row and, with --json, as a JSON object.
+ *
+ * Each size runs in a child process of its own, so that its peak resident
+ * set size is not that of an earlier, larger size; the peak is reported
+ * minus the size of the process when the child started.
+ *
+ *   g++ -O2 -fopenmp -I. bench/synthetic_suite.cpp composite.cpp quadtree.cpp linear_quadtree.cpp \
+ *       image.cpp sparse_assembly.cpp solver.cpp linear_solver.cpp grid_laplacian.cpp \
+ *       grid_multigrid.cpp grid_poisson.cpp sparse_multigrid.cpp fft.cpp profile.cpp -o synthetic_suite
+ *   ./synthetic_suite [--sizes 1,4,16,64,200] [--layers 3] [--blobs 4] [--roughness 0.3]
+ *       [--overlap 0.25] [--solver name] [--full] [--json results.json]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "composite.h"
+#include "child.h"
+#include "layer_stack.h"
+
+namespace
+{
+
+struct result_t
+{
+	double megapixels, generate, run, build, vectors, init, solve, reconstruction;
+	long peak_rss;  // kilobytes
+	int width, height, boundary, keypoints, iterations;
+	long long nonzeros;
+};
+
+double elapsed(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+double phase_time(const profiler_t &profiler, const char *name)
+{
+	double t = 0.0;
+	for(const phase_record_t &p : profiler.get_phases())
+		if(p.name.compare(0, std::strlen(name), name) == 0)
+			t += p.wall;
+	return t;
+}
+
+double counter(const profiler_t &profiler, const char *name)
+{
+	for(const auto &c : profiler.get_counters())
+		if(c.first == name)
+			return c.second;
+	return 0.0;
+}
+
+result_t run_size(double megapixels, const stack_options_t &stack, const solver_options_t &options, bool full)
+{
+	result_t r;
+	// a 4:3 canvas
+	r.width = (int)std::sqrt(megapixels * 1e6 * 4.0 / 3.0);
+	r.height = (int)(megapixels * 1e6 / r.width);
+	r.megapixels = (double)r.width * r.height / 1e6;
+
+	image_compositor compositor;
+	compositor.set_solver_options(options);
+	auto t = std::chrono::steady_clock::now();
+	add_stack(compositor, r.width, r.height, stack);
+	compositor.auto_image_size();
+	r.generate = elapsed(t);
+
+	compositor.profile().clear();
+	compositor.run(full);
+	const profiler_t &p = compositor.profile();
+	r.run = phase_time(p, "run");
+	r.build = phase_time(p, "mixed image") + phase_time(p, "boundary") + phase_time(p, "matrices");
+	r.vectors = phase_time(p, "vectors");
+	r.init = phase_time(p, "solver init");
+	r.solve = phase_time(p, "solve ");
+	r.reconstruction = phase_time(p, "reconstruction");
+	r.boundary = (int)counter(p, "boundary_pixels");
+	r.keypoints = full ? r.width * r.height : (int)counter(p, "keypoints");
+	r.nonzeros = (long long)counter(p, "StS_nonzeros");
+	r.iterations = 0;
+	for(int ch = 1; ch <= 3; ++ch)
+		r.iterations = std::max(r.iterations, (int)counter(p, ("channel" + std::to_string(ch) + "_iterations").c_str()));
+	return r;
+}
+
+// runs the size in a child, which sends back its result
+bool run_child(double megapixels, const stack_options_t &stack, const solver_options_t &options, bool full,
+	result_t &r)
+{
+	int fds[2];
+	if(pipe(fds) != 0)
+		return false;
+	std::fflush(stdout);
+	pid_t pid = fork();
+	if(pid < 0)
+		return false;
+	if(pid == 0)
+	{
+		close(fds[0]);
+		long baseline = current_rss();
+		result_t out = run_size(megapixels, stack, options, full);
+		out.peak_rss = peak_rss() - baseline;
+		bool ok = write_all(fds[1], &out, sizeof(out));
+		std::fflush(stdout);
+		_exit(ok ? 0 : 1);
+	}
+
+	close(fds[1]);
+	bool ok = read_all(fds[0], &r, sizeof(r));
+	close(fds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<double> sizes = { 1, 4, 16 };
+	stack_options_t stack;
+	solver_options_t options;
+	options.solver = solver_t::automatic;
+	bool full = false;
+	const char *json_path = nullptr;
+	for(int i = 1; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+		if(!std::strcmp(argv[i], "--sizes") && has_value)
+		{
+			sizes.clear();
+			for(char *s = argv[++i]; *s; )
+			{
+				sizes.push_back(std::strtod(s, &s));
+				if(*s == ',') ++s;
+				else if(*s) break;
+			}
+		} else if(!std::strcmp(argv[i], "--layers") && has_value) {
+			stack.layers = std::max(1, std::atoi(argv[++i]));
+		} else if(!std::strcmp(argv[i], "--blobs") && has_value) {
+			stack.blobs = std::max(1, std::atoi(argv[++i]));
+		} else if(!std::strcmp(argv[i], "--roughness") && has_value) {
+			stack.roughness = std::atof(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--overlap") && has_value) {
+			stack.overlap = std::atof(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--solver") && has_value) {
+			if(!parse_solver(argv[++i], options.solver))
+			{
+				std::fprintf(stderr, "unknown solver %s\n", argv[i]);
+				return 1;
+			}
+		} else if(!std::strcmp(argv[i], "--full")) {
+			full = true;
+		} else if(!std::strcmp(argv[i], "--json") && has_value) {
+			json_path = argv[++i];
+		} else {
+			std::fprintf(stderr, "usage: %s [--sizes 1,4,16] [--layers n] [--blobs n] [--roughness r]"
+				" [--overlap a] [--solver name] [--full] [--json file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<result_t> results;
+	for(double mp : sizes)
+	{
+		results.emplace_back();
+		if(!run_child(mp, stack, options, full, results.back()))
+		{
+			std::fprintf(stderr, "the run of %g MP failed\n", mp);
+			return 1;
+		}
+	}
+
+	// the compositor prints its progress above, the table comes last
+	std::printf("\nlayers %d, blobs %d, roughness %.2f, overlap %.2f, solver %s%s\n", stack.layers, stack.blobs,
+		stack.roughness, stack.overlap, solver_name(options.solver), full ? ", full resolution" : "");
+	std::printf("%9s %11s %9s %9s %9s %9s %9s %9s %8s %10s %9s %6s %9s\n", "MP", "canvas", "generate", "build",
+		"vectors", "init", "solve", "run", "MP/s", "keypoints", "kp ratio", "iter", "peak MB");
+	for(const result_t &r : results)
+		std::printf("%9.2f %5dx%-5d %8.3fs %8.3fs %8.3fs %8.3fs %8.3fs %8.3fs %8.2f %10d %9.5f %6d %9.1f\n",
+			r.megapixels, r.width, r.height, r.generate, r.build, r.vectors, r.init, r.solve, r.run,
+			r.megapixels / r.run, r.keypoints, r.keypoints / (r.megapixels * 1e6), r.iterations, r.peak_rss / 1024.0);
+
+	if(json_path)
+	{
+		std::FILE *file = std::fopen(json_path, "w");
+		if(!file)
+		{
+			std::fprintf(stderr, "cannot write %s\n", json_path);
+			return 1;
+		}
+		std::fprintf(file, "{\n  \"layers\": %d, \"blobs\": %d, \"roughness\": %g, \"overlap\": %g,"
+			" \"solver\": \"%s\", \"full\": %s,\n  \"results\": [\n", stack.layers, stack.blobs, stack.roughness,
+			stack.overlap, solver_name(options.solver), full ? "true" : "false");
+		for(size_t i = 0; i < results.size(); ++i)
+		{
+			const result_t &r = results[i];
+			std::fprintf(file, "    { \"megapixels\": %.4f, \"width\": %d, \"height\": %d, \"generate_s\": %.6f,"
+				" \"build_s\": %.6f, \"vectors_s\": %.6f, \"solver_init_s\": %.6f, \"solve_s\": %.6f,"
+				" \"reconstruction_s\": %.6f, \"run_s\": %.6f, \"megapixels_per_s\": %.4f, \"boundary_pixels\": %d,"
+				" \"keypoints\": %d, \"keypoint_ratio\": %.6f, \"nonzeros\": %lld, \"iterations\": %d,"
+				" \"peak_rss_kb\": %ld }%s\n",
+				r.megapixels, r.width, r.height, r.generate, r.build, r.vectors, r.init, r.solve, r.reconstruction,
+				r.run, r.megapixels / r.run, r.boundary, r.keypoints, r.keypoints / (r.megapixels * 1e6), r.nonzeros,
+				r.iterations, r.peak_rss, i + 1 < results.size() ? "," : "");
+		}
+		std::fputs("  ]\n}\n", file);
+		std::fclose(file);
+	}
+	return 0;
+}
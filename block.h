@@ -0,0 +1,12 @@
+#ifndef __BLOCK_H__
+#define __BLOCK_H__
+
+#include <eigen3/Eigen/Dense>
+
+// dense values of a linear system, one row per unknown and one column per
+// colour channel, so the three channels of an unknown are adjacent in memory
+using block_t = Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>;
+// the same in single precision, for the inner solves of the mixed-precision mode
+using block_f_t = Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>;
+
+#endif
@@ -1,13 +1,33 @@
 #include "composite.h"
 #include "layer.h"
 #include "quadtree.h"
+#include "linear_quadtree.h"
 #include "image.h"
+#include "sparse_assembly.h"
+#include "solver.h"
+#include "linear_solver.h"
 #include <cassert>
-#include <eigen3/Eigen/src/IterativeLinearSolvers/ConjugateGradient.h>
 #include <memory>
 #include <cmath>
+#include <cstring>
+#include <string>
+#include <algorithm>
 #include <unordered_map>
 
+namespace
+{
+
+// std::round for values well inside the int range, without the library call:
+// v - (int)v is exact
+inline int round_half_away(double v)
+{
+	int r = (int)v;
+	double f = v - r;
+	return r + (f >= 0.5) - (f <= -0.5);
+}
+
+}
+
 void image_compositor::build_mixed_image()
 {
 	img_delta = std::make_shared<image_t>(width, height, 3);
@@ -31,10 +51,11 @@ void image_compositor::build_boundary()
 	for(int t = std::max(width, height); range < t; range <<= 1);
 	qtree = std::make_shared<quadtree_t>(0, range, 0, range);
 	static int dir[][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	std::vector<point_t> points;
 	for(int i = 0; i < width; ++i)
-		qtree->split(height - 1, i, 1);
+		points.emplace_back(height - 1, i);
 	for(int i = 0; i < height; ++i)
-		qtree->split(i, width - 1, 1);
+		points.emplace_back(i, width - 1);
 	for(int i = 0; i < height; ++i)
 	{
 		for(int j = 0; j < width; ++j)
@@ -48,7 +69,7 @@ void image_compositor::build_boundary()
 				{
 					if(z_index->get(ti, tj, 0) != z)
 					{
-						qtree->split(i, j, 1);
+						points.emplace_back(i, j);
 						++boundary_cnt;
 						break;
 					}
@@ -58,17 +79,37 @@ void image_compositor::build_boundary()
 	}
 
 	std::printf("Found boundary points %d\n", boundary_cnt);
+	profiler.counter("boundary_pixels", boundary_cnt);
+	qtree->build(points);
+	lqtree = std::make_shared<linear_quadtree_t>(*qtree);
 
 	/* (2) load keypoints */
+	// a keypoint is the upper-left corner of a leaf, and every leaf has a
+	// distinct one, so only the leaves inside the image need to be checked
+	std::vector<point_t> corners;
+	lqtree->traverse([&](int xl, int, int yl, int) {
+		if(xl >= height || yl >= width)
+			return;
+		if(xl != 0 && yl != 0)
+		{
+			auto outer = lqtree->find_outer(xl, yl);
+			if(outer->xr != xl || outer->yr != yl)
+				return;
+		}
+		corners.emplace_back(xl, yl);
+	} );
+
+	// number them in scanline order
+	std::sort(corners.begin(), corners.end());
 	int keypoint_count = 0;
-	for(int i = 0; i < height; ++i)
-	{
-		for(int j = 0; j < width; ++j)
-			if(qtree->is_keypoint(i, j))
-				keypoints[std::make_pair(i, j)] = keypoint_count++;
-	}
+	keypoints.clear();
+	keypoints.reserve(corners.size());
+	for(auto p : corners)
+		keypoints.insert(p.first, p.second, keypoint_count++);
 
 	std::printf("Found key points %d\n", keypoint_count);
+	profiler.counter("keypoints", keypoint_count);
+	profiler.counter("quadtree_leaves", lqtree->leaf_count());
 }
 
 uint8_t image_compositor::get_color(int x, int y, int ch, int ignore_z)
@@ -84,41 +125,12 @@ uint8_t image_compositor::get_color(int x, int y, int ch, int ignore_z)
 	return 255;
 }
 
-void image_compositor::apply_gradient_matrix(const std::vector<interp_line_t>& S, const std::vector<double> B[3], int size)
-{
-	std::puts("  Computing sparse matrix StS...");
-	std::map<std::pair<int, int>, double> M;
-	for(auto &line : S)
-	{
-		for(auto mv1 : line)
-			for(auto mv2 : line)
-				M[ std::make_pair(mv1.first, mv2.first) ] += mv1.second * mv2.second;
-	}
-
-	std::vector<Eigen::Triplet<double>> items;
-	for(auto it : M)
-		items.push_back( { it.first.first, it.first.second, it.second } );
-
-	StS = std::make_shared<Eigen::SparseMatrix<double>>(size, size);
-	StS->setFromTriplets(items.begin(), items.end());
-	StS->makeCompressed();
-
-	std::puts("  Computing sparse vectors StB...");
-	for(int ch = 0; ch < 3; ++ch)
-	{
-		StB[ch] = std::make_shared<Eigen::SparseVector<double>>(size);
-		StB[ch]->setZero();
-		for(int i = 0; i < (int)S.size(); ++i)
-			for(auto mv : S[i])
-				StB[ch]->coeffRef(mv.first) += mv.second * B[ch][i];
-	}
-}
-
-void image_compositor::build_full_matrices()
+void image_compositor::build_full_vectors()
 {
-	std::puts("  Building matrix S and vector B...");
-	std::vector<std::vector<mv_t>> S;
-	std::vector<double> B[3];
+	// StS is the grid Laplacian applied by grid_laplacian_t, only StB = S^T B
+	// is built: every seam gradient is added to one pixel and taken from the other
+	std::puts("  Building vector StB...");
+	StB = block_t::Zero(height * width, 3);
 	for(int i = 0; i < height; ++i)
 	{
 		for(int j = 0; j < width; ++j)
@@ -128,260 +140,637 @@ void image_compositor::build_full_matrices()
 				int ti = i - axis, tj = j - (1 - axis);
 				if(ti < 0 || tj < 0) continue;
 
-				// interpolation matrix
-				std::vector<mv_t> line;
-				line.push_back( mv_t(i * width + j, 1.0) );
-				line.push_back( mv_t(ti * width + tj, -1.0) );
-				S.emplace_back(std::move(line));
-
-				// B vector
-				int z = z_index->get(i, j, 0);
-				int z_t = z_index->get(ti, tj, 0);
-				if(z != z_t)
+				double g[3];
+				if(seam_gradient(i, j, ti, tj, g))
 				{
-					int z_m = std::max(z, z_t) - 1;
 					for(int ch = 0; ch < 3; ++ch)
 					{
-						int g0 = img_mixed->get(i, j, ch) - img_mixed->get(ti, tj, ch);
-						int g1 = get_color(i, j, ch, z_m) - get_color(ti, tj, ch, z_m);
-						B[ch].push_back(g1 - g0);
+						StB(i * width + j, ch) += g[ch];
+						StB(ti * width + tj, ch) -= g[ch];
 					}
-				} else {
-					for(int ch = 0; ch < 3; ++ch)
-						B[ch].push_back(0.0);
 				}
 			}
 		}
 	}
+}
+
+bool image_compositor::seam_gradient(int i, int j, int ti, int tj, double g[3])
+{
+	int z = z_index->get(i, j, 0);
+	int z_t = z_index->get(ti, tj, 0);
+	if(z == z_t)
+		return false;
 
-	std::vector<mv_t> last_line;
-	last_line.push_back( { width * height - 1, 1.0 } );
-	S.push_back(last_line);
+	int z_m = std::max(z, z_t) - 1;
 	for(int ch = 0; ch < 3; ++ch)
 	{
-		B[ch].push_back(0.0);
-		assert(B[ch].size() == S.size());
+		int g0 = img_mixed->get(i, j, ch) - img_mixed->get(ti, tj, ch);
+//		int g1 = layers[z_m]->get_color(i, j, ch) - layers[z_m]->get_color(ti, tj, ch);
+		int g1 = get_color(i, j, ch, z_m) - get_color(ti, tj, ch, z_m);
+		g[ch] = g1 - g0;
+	}
+
+	return true;
+}
+
+void image_compositor::leaf_element(const quadtree_t::node_t &n, double K[4][4])
+{
+	// For two neighbouring pixels of the same leaf, the row of S is the
+	// difference of their bilinear corner weights. Across a column that
+	// difference does not depend on the row (and vice versa), so the sum of
+	// the outer products only needs one pass over each side of the leaf.
+	double area = n.get_range() * n.get_range();
+	int xr = std::min(n.xr, height), yr = std::min(n.yr, width);
+	int nx = xr - n.xl - 1, ny = yr - n.yl - 1;
+
+	for(int c = 0; c < 4; ++c)
+		for(int t = 0; t < 4; ++t)
+			K[c][t] = 0.0;
+
+	auto add = [&](const double d[4], int times) {
+		for(int c = 0; c < 4; ++c)
+			for(int t = 0; t < 4; ++t)
+				K[c][t] += times * d[c] * d[t];
+	};
+
+	if(nx > 0)
+	{
+		for(int y = n.yl; y < yr; ++y)
+		{
+			double a = (n.yr - y) / area, b = (y - n.yl) / area;
+			double d[4] = { -a, -b, a, b };
+			add(d, nx);
+		}
 	}
 
-	apply_gradient_matrix(S, B, height * width);
+	if(ny > 0)
+	{
+		for(int x = n.xl; x < xr; ++x)
+		{
+			double a = (n.xr - x) / area, b = (x - n.xl) / area;
+			double d[4] = { -a, a, -b, b };
+			add(d, ny);
+		}
+	}
 }
 
 void image_compositor::build_matrices()
 {
 	/* (1) build interpolation matrix */
-	std::puts("  Building interpolation lines...");
-	for(int i = 0; i < height; ++i)
-		for(int j = 0; j < width; ++j)
-			interp.emplace_back(build_interp_line(i, j));
+	std::puts("  Building corner interpolation...");
+	{
+		auto phase = profiler.phase("corner interpolation");
+		build_corners();
+	}
 
-	std::puts("  Building matrix S and vector B...");
-	std::vector<std::vector<std::pair<int, double>>> S;
-	std::vector<double> B[3];
-	for(int i = 0; i < height; ++i)
+	/* (2) pixel pairs inside a leaf, summed per leaf in closed form */
+	// a pixel next to a different layer is a leaf of its own, so B is zero for these
+	std::puts("  Building leaf elements...");
+	auto leaf_phase = profiler.phase("leaf elements");
+	std::vector<Eigen::Triplet<double>> elements;
+	for(int k = 0; k < lqtree->leaf_count(); ++k)
 	{
-		for(int j = 0; j < width; ++j)
+		const quadtree_t::node_t &n = lqtree->leaf(k);
+		if(n.xl >= height || n.yl >= width || n.get_range() == 1)
+			continue;
+
+		double K[4][4];
+		leaf_element(n, K);
+		for(int c = 0; c < 4; ++c)
 		{
-			for(int axis = 0; axis < 2; ++axis)
+			for(int t = 0; t < 4; ++t)
 			{
-				int ti = i - axis, tj = j - (1 - axis);
-				if(ti < 0 || tj < 0) continue;
-
-				// interpolation matrix
-				std::map<int, double> line;
-				for(mv_t mv : interp[i * width + j])
-					line[mv.first] += mv.second;
-				for(mv_t mv : interp[ti * width + tj])
-					line[mv.first] -= mv.second;
-				std::vector<std::pair<int, double>> vec_line;
-				for(mv_t mv : line) vec_line.push_back(mv);
-				S.emplace_back(std::move(vec_line));
-
-				// B vector
-				int z = z_index->get(i, j, 0);
-				int z_t = z_index->get(ti, tj, 0);
-				if(z != z_t)
+				if(K[c][t] == 0.0)
+					continue;
+				for(int u = corner_offset[k * 4 + c]; u < corner_offset[k * 4 + c + 1]; ++u)
 				{
-					int z_m = std::max(z, z_t) - 1;
-					for(int ch = 0; ch < 3; ++ch)
+					for(int v = corner_offset[k * 4 + t]; v < corner_offset[k * 4 + t + 1]; ++v)
 					{
-						int g0 = img_mixed->get(i, j, ch) - img_mixed->get(ti, tj, ch);
-	//					int g1 = layers[z_m]->get_color(i, j, ch) - layers[z_m]->get_color(ti, tj, ch);
-						int g1 = get_color(i, j, ch, z_m) - get_color(ti, tj, ch, z_m);
-						B[ch].push_back(g1 - g0);
+						mv_t a = corner_weights[u], b = corner_weights[v];
+						elements.push_back( { a.first, b.first, K[c][t] * a.second * b.second } );
 					}
-				} else {
-					for(int ch = 0; ch < 3; ++ch)
-						B[ch].push_back(0.0);
 				}
 			}
 		}
 	}
 
-	S.push_back(interp[height * width - 1]);
-	for(int ch = 0; ch < 3; ++ch)
+	/* (3) pixel pairs across the upper and left sides of every leaf */
+	// only the pairs across a seam have a gradient, their rows are kept for StB
+	std::puts("  Building matrix S...");
+	leaf_phase.end();
+	auto S_phase = profiler.phase("S");
+	std::vector<interp_line_t> S;
+	seam_rows.clear();
+	seam_pixels.clear();
+	interp_line_t line, line_t;
+	auto push_edge = [&](int i, int j, int ti, int tj) {
+		build_interp_line(i, j, line);
+		build_interp_line(ti, tj, line_t);
+		S.emplace_back();
+		subtract_lines(line, line_t, S.back());
+		if(z_index->get(i, j, 0) != z_index->get(ti, tj, 0))
+		{
+			seam_rows.push_back(S.back());
+			seam_pixels.push_back( { i, j, ti, tj } );
+		}
+	};
+
+	for(int k = 0; k < lqtree->leaf_count(); ++k)
 	{
-		B[ch].push_back(0.0);
-		assert(B[ch].size() == S.size());
+		const quadtree_t::node_t &n = lqtree->leaf(k);
+		if(n.xl >= height || n.yl >= width)
+			continue;
+		int xr = std::min(n.xr, height), yr = std::min(n.yr, width);
+		if(n.xl > 0)
+			for(int j = n.yl; j < yr; ++j)
+				push_edge(n.xl, j, n.xl - 1, j);
+		if(n.yl > 0)
+			for(int i = n.xl; i < xr; ++i)
+				push_edge(i, n.yl, i, n.yl - 1);
 	}
 
-	apply_gradient_matrix(S, B, keypoints.size());
+	S.emplace_back();
+	build_interp_line(height - 1, width - 1, S.back());
+
+	std::puts("  Computing sparse matrix StS...");
+	S_phase.end();
+	auto StS_phase = profiler.phase("StS");
+	StS = std::make_shared<Eigen::SparseMatrix<double>>();
+	assemble_normal_matrix(S, keypoints.size(), elements, *StS);
+	profiler.counter("S_rows", S.size());
+	profiler.counter("seam_rows", seam_rows.size());
+	profiler.counter("StS_nonzeros", StS->nonZeros());
 }
 
-image_compositor::interp_line_t image_compositor::build_interp_line(int x, int y)
+void image_compositor::build_vectors()
 {
-	interp_line_t line;
-	auto it = keypoints.find( { x, y } );
-	if(it != keypoints.end())
+	std::puts("  Computing vectors StB...");
+	std::vector<double> B[3];
+	for(int ch = 0; ch < 3; ++ch)
+		B[ch].resize(seam_rows.size());
+	for(int r = 0; r < (int)seam_rows.size(); ++r)
 	{
-		line.push_back( { it->second, 1.0 } );
-		return line;
+		const std::array<int, 4> &p = seam_pixels[r];
+		double g[3];
+		seam_gradient(p[0], p[1], p[2], p[3], g);
+		for(int ch = 0; ch < 3; ++ch)
+			B[ch][r] = g[ch];
 	}
 
-	std::unordered_map<int, double> weight;
+	assemble_normal_vectors(seam_rows, keypoints.size(), B, StB);
+}
 
-	quadtree_t *node = qtree->find(x, y);
+uint64_t image_compositor::geometry_fingerprint(bool full_keypoints) const
+{
+	// z_index is what the masks, offsets and canvas size decide (FNV-1a)
+	uint64_t h = 0xcbf29ce484222325ull;
+	auto mix = [&](uint64_t v) {
+		for(int k = 0; k < 8; ++k, v >>= 8)
+			h = (h ^ (v & 0xff)) * 0x100000001b3ull;
+	};
+	mix(width), mix(height), mix(full_keypoints);
+	const uint8_t *z = z_index->buf;
+	for(size_t k = 0, n = (size_t)width * height; k < n; ++k)
+		h = (h ^ z[k]) * 0x100000001b3ull;
+	return h;
+}
 
-	int X[4], Y[4];
-	double W[4];
-	double area = node->get_range() * node->get_range();
-	X[0] = node->xl; Y[0] = node->yl;
-	W[0] = (node->xr - x) * (node->yr - y) / area;
-	X[1] = node->xl; Y[1] = node->yr;
-	W[1] = (node->xr - x) * (y - node->yl) / area;
-	X[2] = node->xr; Y[2] = node->yl;
-	W[2] = (x - node->xl) * (node->yr - y) / area;
-	X[3] = node->xr; Y[3] = node->yr;
-	W[3] = (x - node->xl) * (y - node->yl) / area;
-
-	for(int i = 0; i < 4; ++i)
+bool image_compositor::same_geometry(uint64_t key, bool full_keypoints) const
+{
+	// a hash collision must not reuse another geometry
+	if(key != geometry_key || !geometry_z)
+		return false;
+	if(geometry_width != width || geometry_height != height || geometry_full != full_keypoints)
+		return false;
+	return !std::memcmp(geometry_z->buf, z_index->buf, (size_t)width * height * z_index->c);
+}
+
+void image_compositor::subtract_lines(const interp_line_t &a, const interp_line_t &b, interp_line_t &out)
+{
+	// both lines are sorted by keypoint
+	out.clear();
+	int i = 0, j = 0;
+	while(i < (int)a.size() || j < (int)b.size())
 	{
-		if(W[i] < 1.0e-5)
-			continue;
+		if(j == (int)b.size() || (i < (int)a.size() && a[i].first < b[j].first))
+			out.push_back(a[i++]);
+		else if(i == (int)a.size() || b[j].first < a[i].first)
+			out.push_back( { b[j].first, -b[j].second } ), ++j;
+		else
+		{
+			double w = a[i].second - b[j].second;
+			if(w != 0.0)
+				out.push_back( { a[i].first, w } );
+			++i, ++j;
+		}
+	}
+}
 
-		auto it = keypoints.find( { X[i], Y[i] } );
-		if(it != keypoints.end())
+void image_compositor::build_corners()
+{
+	// a corner that is not a keypoint is interpolated along the edge it lies on
+	auto expand = [&](int X, int Y) {
+		int id = keypoints.find(X, Y);
+		if(id >= 0)
 		{
-			weight[it->second] += W[i];
-		} else {
-			auto interp_edge = [&](quadtree_t *n) {
-				if(X[i] == n->xl || X[i] == n->xr)
+			corner_weights.push_back( { id, 1.0 } );
+			return;
+		}
+
+		auto interp_edge = [&](const quadtree_t::node_t *n) {
+			if(n == nullptr)
+				return;
+
+			if(X == n->xl || X == n->xr)
+			{
+				int id_l = keypoints.find(X, n->yl);
+				int id_r = keypoints.find(X, n->yr);
+				if(id_l >= 0 && id_r >= 0)
 				{
-					auto it_l = keypoints.find( { X[i], n->yl } );
-					auto it_r = keypoints.find( { X[i], n->yr } );
-					if(it_l != keypoints.end() && it_r != keypoints.end())
-					{
-						double len = n->yr - n->yl;
-						weight[it_r->second] += W[i] * (Y[i] - n->yl) / len;
-						weight[it_l->second] += W[i] * (n->yr - Y[i]) / len;
-					}
+					double len = n->yr - n->yl;
+					corner_weights.push_back( { id_r, (Y - n->yl) / len } );
+					corner_weights.push_back( { id_l, (n->yr - Y) / len } );
 				}
+			}
 
-				if(Y[i] == n->yl || Y[i] == n->yr)
+			if(Y == n->yl || Y == n->yr)
+			{
+				int id_l = keypoints.find(n->xl, Y);
+				int id_r = keypoints.find(n->xr, Y);
+				if(id_l >= 0 && id_r >= 0)
 				{
-					auto it_l = keypoints.find( { n->xl, Y[i] } );
-					auto it_r = keypoints.find( { n->xr, Y[i] } );
-					if(it_l != keypoints.end() && it_r != keypoints.end())
-					{
-						double len = n->xr - n->xl;
-						weight[it_r->second] += W[i] * (X[i] - n->xl) / len;
-						weight[it_l->second] += W[i] * (n->xr - X[i]) / len;
-					}
+					double len = n->xr - n->xl;
+					corner_weights.push_back( { id_r, (X - n->xl) / len } );
+					corner_weights.push_back( { id_l, (n->xr - X) / len } );
 				}
-			};
+			}
+		};
 
-			interp_edge(qtree->find(X[i], Y[i]));
-			interp_edge(qtree->find_outer(X[i], Y[i]));
+		interp_edge(lqtree->find(X, Y));
+		interp_edge(lqtree->find_outer(X, Y));
+	};
+
+	corner_offset.assign(1, 0);
+	corner_weights.clear();
+	for(int k = 0; k < lqtree->leaf_count(); ++k)
+	{
+		const quadtree_t::node_t &n = lqtree->leaf(k);
+		int X[4] = { n.xl, n.xl, n.xr, n.xr };
+		int Y[4] = { n.yl, n.yr, n.yl, n.yr };
+		bool inside = n.xl < height && n.yl < width;
+		for(int c = 0; c < 4; ++c)
+		{
+			if(inside)
+				expand(X[c], Y[c]);
+			corner_offset.push_back(corner_weights.size());
 		}
 	}
+}
 
-	for(auto it : weight)
-		line.push_back(it);
-
-	return line;
+void image_compositor::corner_bilinear(const quadtree_t::node_t &n, int x, int y, double W[4])
+{
+	double area = n.get_range() * n.get_range();
+	W[0] = (n.xr - x) * (n.yr - y) / area;
+	W[1] = (n.xr - x) * (y - n.yl) / area;
+	W[2] = (x - n.xl) * (n.yr - y) / area;
+	W[3] = (x - n.xl) * (y - n.yl) / area;
 }
 
-void image_compositor::run(bool full_keypoings)
+void image_compositor::build_interp_line(int x, int y, interp_line_t &line)
 {
-	std::puts("Building mixed image...");
-	build_mixed_image();
-	if(!full_keypoings)
+	line.clear();
+	const quadtree_t::node_t *node = lqtree->find(x, y);
+	int leaf = lqtree->leaf_index(node);
+
+	double W[4];
+	corner_bilinear(*node, x, y, W);
+	for(int c = 0; c < 4; ++c)
 	{
-		std::puts("Calculating boundary...");
-		build_boundary();
+		if(W[c] == 0.0)
+			continue;
+		int *offset = &corner_offset[leaf * 4 + c];
+		for(int k = offset[0]; k < offset[1]; ++k)
+			line.push_back( { corner_weights[k].first, W[c] * corner_weights[k].second } );
 	}
 
-	std::puts("Calculating matrices...");
-	if(full_keypoings) build_full_matrices();
-	else build_matrices();
-
-	std::puts("Initializing solver...");
-	Eigen::ConjugateGradient<Eigen::SparseMatrix<double>> solver;
-	solver.compute(*StS);
-	img_result = std::make_shared<image_t>(width, height, 3);
+	// merge the keypoints shared by several corners
+	std::sort(line.begin(), line.end(), [](const mv_t &a, const mv_t &b) {
+		return a.first < b.first;
+	} );
+	int n = 0;
+	for(int k = 0; k < (int)line.size(); ++k)
+	{
+		if(n > 0 && line[n - 1].first == line[k].first)
+			line[n - 1].second += line[k].second;
+		else line[n++] = line[k];
+	}
+	line.resize(n);
+}
 
-	for(int ch = 0; ch < 3; ++ch)
+template<typename Callback>
+void image_compositor::traverse_delta(const block_t &x, bool full_keypoints, const Callback &callback)
+{
+	double d[3];
+	if(full_keypoints)
 	{
-		std::printf("Calculating channel %d...\n", ch + 1);
-		int size = full_keypoings ? height * width : keypoints.size();
-		std::vector<double> x(size, 0.0);
-		Eigen::SparseVector<double> ans = solver.solve(*StB[ch]);
-		for(Eigen::SparseVector<double>::InnerIterator it(ans); it; ++it)
-			x[it.index()] = it.value();
-
-		double mean = 0.0, max = -1.0e4, min = 1.0e4;
-		std::vector<double> delta(height * width, 0.0);
 		for(int i = 0; i < height; ++i)
 		{
 			for(int j = 0; j < width; ++j)
 			{
-				double val = 0.0;
-				if(full_keypoings)
-				{
-					val = x[i * width + j];
-				} else {
-					for(mv_t mv : interp[i * width + j])
-						val += x[mv.first] * mv.second;
-				}
-				delta[i * width + j] = val;
-				mean += val;
-				max = std::max(max, val);
-				min = std::min(min, val);
+				for(int ch = 0; ch < 3; ++ch)
+					d[ch] = x(i * width + j, ch);
+				callback(i, j, d);
 			}
 		}
 
-		mean /= height * width;
-		std::printf("mean = %.5lf\n", mean);
-		for(int i = 0; i < height; ++i)
+		return;
+	}
+
+	// the delta inside a leaf is the bilinear blend of its corner values
+	for(int k = 0; k < lqtree->leaf_count(); ++k)
+	{
+		const quadtree_t::node_t &n = lqtree->leaf(k);
+		if(n.xl >= height || n.yl >= width)
+			continue;
+
+		double value[4][3] = { };
+		for(int c = 0; c < 4; ++c)
 		{
-			for(int j = 0; j < width; ++j)
+			for(int t = corner_offset[k * 4 + c]; t < corner_offset[k * 4 + c + 1]; ++t)
+			{
+				mv_t mv = corner_weights[t];
+				for(int ch = 0; ch < 3; ++ch)
+					value[c][ch] += x(mv.first, ch) * mv.second;
+			}
+		}
+
+		// corner_bilinear spelled out, the area is a power of two so its
+		// reciprocal is exact
+		int xr = std::min(n.xr, height), yr = std::min(n.yr, width);
+		double inv_area = 1.0 / ((double)n.get_range() * n.get_range());
+		for(int i = n.xl; i < xr; ++i)
+		{
+			int a = n.xr - i, b = i - n.xl;
+			for(int j = n.yl; j < yr; ++j)
+			{
+				int c = n.yr - j, e = j - n.yl;
+				double W[4] = { a * c * inv_area, a * e * inv_area, b * c * inv_area, b * e * inv_area };
+				for(int ch = 0; ch < 3; ++ch)
+					d[ch] = W[0] * value[0][ch] + W[1] * value[1][ch] + W[2] * value[2][ch] + W[3] * value[3][ch];
+				callback(i, j, d);
+			}
+		}
+	}
+}
+
+std::vector<std::vector<int>> image_compositor::build_keypoint_aggregates(int coarsest)
+{
+	// keypoints in the same quadtree node of side 2^s are merged, so the
+	// aggregates nest and follow the tree: fine where the seam refined it
+	// and already coarse where the leaves are large. A node size that
+	// barely merges anything is skipped.
+	int n = keypoints.size();
+	std::vector<point_t> position(n);
+	keypoints.for_each([&](int x, int y, int id) { position[id] = { x, y }; });
+
+	std::vector<std::vector<int>> aggregates;
+	for(int shift = 1; n > coarsest && (1 << shift) <= 2 * qtree->get_range(); ++shift)
+	{
+		keypoint_index_t nodes;
+		nodes.reserve(n);
+		std::vector<int> aggregate(n);
+		std::vector<point_t> coarse_position;
+		for(int i = 0; i < n; ++i)
+		{
+			int X = position[i].first >> shift, Y = position[i].second >> shift;
+			int id = nodes.find(X, Y);
+			if(id < 0)
+			{
+				id = coarse_position.size();
+				nodes.insert(X, Y, id);
+				coarse_position.push_back(position[i]);
+			}
+			aggregate[i] = id;
+		}
+
+		if(4 * (int)coarse_position.size() > 3 * n && (1 << shift) < qtree->get_range())
+			continue;
+		aggregates.push_back(std::move(aggregate));
+		position.swap(coarse_position);
+		n = position.size();
+	}
+
+	return aggregates;
+}
+
+Eigen::SparseMatrix<double> image_compositor::build_keypoint_prolongation()
+{
+	// the corners of a grid of cells of side 2^s, the first with at most a
+	// quarter of the keypoints and few enough for a direct solve. Every
+	// keypoint is the bilinear interpolation of the corners of its cell,
+	// which keeps the start smooth where a merge of the keypoints would
+	// jump at the edge of every merged node.
+	int n = keypoints.size();
+	std::vector<point_t> position(n);
+	keypoints.for_each([&](int x, int y, int id) { position[id] = { x, y }; });
+
+	std::vector<Eigen::Triplet<double>> items;
+	int count = 0;
+	for(int shift = 1; ; ++shift)
+	{
+		int side = 1 << shift;
+		keypoint_index_t corners;
+		corners.reserve(n / 2);
+		items.clear();
+		count = 0;
+		for(int i = 0; i < n; ++i)
+		{
+			int X = position[i].first >> shift, Y = position[i].second >> shift;
+			double tx = double(position[i].first - X * side) / side;
+			double ty = double(position[i].second - Y * side) / side;
+			double w[4] = { (1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty };
+			for(int c = 0; c < 4; ++c)
 			{
-				double d = delta[i * width + j];
-				int val = std::round(img_mixed->get(i, j, ch) + d - mean);
-				val = std::max(0, std::min(255, val));
-				img_result->get_ptr(i, j)[ch] = val;
-				img_delta->get_ptr(i, j)[ch] = (d - min) / (max - min) * 255;
+				if(w[c] == 0.0)
+					continue;
+				int cx = X + (c & 1), cy = Y + (c >> 1);
+				int id = corners.find(cx, cy);
+				if(id < 0)
+					corners.insert(cx, cy, id = count++);
+				items.emplace_back(i, id, w[c]);
 			}
 		}
+		if((4 * count <= n && count <= 16384) || side >= qtree->get_range())
+			break;
 	}
+
+	Eigen::SparseMatrix<double> P(n, count);
+	P.setFromTriplets(items.begin(), items.end());
+	return P;
+}
+
+void image_compositor::run(bool full_keypoings)
+{
+	auto run_phase = profiler.phase("run");
+	profiler.counter("width", width);
+	profiler.counter("height", height);
+	profiler.counter("layers", layers.size());
+
+	std::puts("Building mixed image...");
+	{
+		auto phase = profiler.phase("mixed image");
+		build_mixed_image();
+	}
+
+	// the quadtree, S, StS and the solver only depend on the geometry
+	uint64_t key = geometry_fingerprint(full_keypoings);
+	bool reuse = same_geometry(key, full_keypoings);
+	profiler.counter("geometry_reused", reuse);
+	if(!reuse)
+	{
+		// build_mixed_image makes a new z_index every run, this one stays as it is
+		geometry_key = key;
+		geometry_z = z_index;
+		geometry_width = width;
+		geometry_height = height;
+		geometry_full = full_keypoings;
+		solver.reset();
+		if(!full_keypoings)
+		{
+			std::puts("Calculating boundary...");
+			{
+				auto phase = profiler.phase("boundary");
+				build_boundary();
+			}
+			std::puts("Calculating matrices...");
+			auto phase = profiler.phase("matrices");
+			build_matrices();
+		} else {
+			qtree.reset();
+			lqtree.reset();
+		}
+	} else std::puts("Reusing the geometry of the previous run...");
+
+	std::puts("Calculating vectors...");
+	{
+		auto phase = profiler.phase("vectors");
+		if(full_keypoings) build_full_vectors();
+		else build_vectors();
+	}
+	profiler.counter("unknowns", StB.rows());
+
+	if(!solver)
+	{
+		std::puts("Initializing solver...");
+		auto phase = profiler.phase("solver init");
+		if(full_keypoings)
+		{
+			solver = make_grid_solver(width, height, solver_options);
+		} else {
+			std::vector<std::vector<int>> aggregates;
+			Eigen::SparseMatrix<double> coarse;
+			bool hierarchy = solver_options.solver == solver_t::multigrid
+				|| solver_options.solver == solver_t::multigrid_cg;
+			if(hierarchy)
+				aggregates = build_keypoint_aggregates(solver_options.multigrid.coarsest);
+			if(solver_options.warm_start)
+				coarse = build_keypoint_prolongation();
+			solver = make_solver(*StS, solver_options, hierarchy ? &aggregates : nullptr,
+				solver_options.warm_start ? &coarse : nullptr);
+		}
+	}
+
+	std::printf("Calculating channels (%s)...\n", solver->name());
+	// the three channels share every product with StS, so they also share
+	// one phase
+	auto solve_phase = profiler.phase(std::string("solve ") + solver->name());
+	block_t x = block_t::Zero(StB.rows(), 3);
+	solver_stats_t stats = solver->solve(StB, x);
+	solve_phase.end();
+	solver->report();
+	for(int ch = 0; ch < 3; ++ch)
+	{
+		std::string channel = "channel" + std::to_string(ch + 1);
+		profiler.counter(channel + "_iterations", stats.iterations[ch]);
+		profiler.counter(channel + "_error", stats.error[ch]);
+	}
+
+	img_result = std::make_shared<image_t>(width, height, 3);
+
+	for(int ch = 0; ch < 3; ++ch)
+		std::printf("  channel %d: %d iterations, error %g\n", ch + 1, stats.iterations[ch], stats.error[ch]);
+	// first iteration at which every channel is below 1e-1, 1e-2, ...
+	std::printf("  residual history:");
+	double level = 0.1;
+	for(int it = 0; it < (int)stats.history.size(); ++it)
+		for(; level > 1.0e-16 && stats.history[it].maxCoeff() < level; level /= 10.0)
+			std::printf(" %.0e@%d", level, it);
+	std::puts("");
+
+	auto reconstruction_phase = profiler.phase("reconstruction");
+	double mean[3] = { }, max[3], min[3];
+	std::fill(max, max + 3, -1.0e4);
+	std::fill(min, min + 3, 1.0e4);
+	traverse_delta(x, full_keypoings, [&](int, int, const double d[3]) {
+		for(int ch = 0; ch < 3; ++ch)
+		{
+			mean[ch] += d[ch];
+			max[ch] = std::max(max[ch], d[ch]);
+			min[ch] = std::min(min[ch], d[ch]);
+		}
+	} );
+
+	for(int ch = 0; ch < 3; ++ch)
+	{
+		mean[ch] /= height * width;
+		std::printf("mean = %.5lf\n", mean[ch]);
+	}
+
+	// all three images are width x height x 3, (i, j) is inside of them
+	traverse_delta(x, full_keypoings, [&](int i, int j, const double d[3]) {
+		size_t p = ((size_t)i * width + j) * 3;
+		const uint8_t *mixed = img_mixed->buf + p;
+		uint8_t *result = img_result->buf + p, *delta = img_delta->buf + p;
+		for(int ch = 0; ch < 3; ++ch)
+		{
+			int val = round_half_away(mixed[ch] + d[ch] - mean[ch]);
+			result[ch] = std::max(0, std::min(255, val));
+			delta[ch] = (d[ch] - min[ch]) / (max[ch] - min[ch]) * 255;
+		}
+	} );
+}
+
+void image_compositor::set_solver_options(const solver_options_t &options)
+{
+	solver_options = options;
+	solver.reset();
 }
 
 void image_compositor::save_quadtree(const char *path)
 {
-	qtree->dump_to(path, width, height);
+	// there is no quadtree in the full-resolution mode
+	if(qtree)
+	{
+		auto phase = profiler.phase(std::string("save ") + path);
+		qtree->dump_to(path, width, height);
+	}
 }
 
 void image_compositor::save_mixed_image(const char *path)
 {
+	auto phase = profiler.phase(std::string("save ") + path);
 	img_mixed->write(path);
 }
 
 void image_compositor::save_image(const char *path)
 {
+	auto phase = profiler.phase(std::string("save ") + path);
 	img_result->write(path);
 }
 
 void image_compositor::save_delta_image(const char *path)
 {
+	auto phase = profiler.phase(std::string("save ") + path);
 	img_delta->write(path);
 }
 
@@ -402,8 +791,23 @@ void image_compositor::auto_image_size()
 	std::printf("Adjust image to %dx%d\n", width, height);
 }
 
+void image_compositor::clear_layers()
+{
+	layers.clear();
+}
+
 void image_compositor::add_layer(const char *image, const char *mask, int offset_x, int offset_y)
 {
+	auto phase = profiler.phase(std::string("load ") + image);
+	auto layer = std::make_shared<layer_t>();
+	layer->load(image, mask);
+	layer->set_offset(offset_x, offset_y);
+	layers.push_back(layer);
+}
+
+void image_compositor::add_layer(std::shared_ptr<image_t> image, image_t *mask, int offset_x, int offset_y)
+{
+	auto phase = profiler.phase("load from memory");
 	auto layer = std::make_shared<layer_t>();
 	layer->load(image, mask);
 	layer->set_offset(offset_x, offset_y);
@@ -1,6 +1,8 @@
 #ifndef __COMPOSITE_H__
 #define __COMPOSITE_H__
 
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <utility>
@@ -8,8 +10,13 @@
 #include <unordered_map>
 #include <eigen3/Eigen/Sparse>
 #include "quadtree.h"
+#include "linear_quadtree.h"
+#include "keypoint_index.h"
 #include "image.h"
+#include "block.h"
+#include "linear_solver.h"
 #include "layer.h"
+#include "profile.h"
 
 class image_compositor
 {
@@ -20,32 +27,73 @@ private:
 
 	int width, height;
 	std::shared_ptr<quadtree_t> qtree;
+	std::shared_ptr<linear_quadtree_t> lqtree;
 	std::shared_ptr<image_t> img_mixed, z_index, img_result, img_delta;
-	std::vector<interp_line_t> interp;
-	std::map<point_t, int> keypoints;
+	// interpolation of the four corners of every leaf from the keypoints,
+	// weights of corner c of leaf k are at [corner_offset[4k + c], corner_offset[4k + c + 1])
+	std::vector<int> corner_offset;
+	std::vector<mv_t> corner_weights;
+	keypoint_index_t keypoints;
 	std::shared_ptr<Eigen::SparseMatrix<double>> StS;
-	std::shared_ptr<Eigen::SparseVector<double>> StB[3];
+	block_t StB;
+	// the rows of S across a seam and their pixel pairs (i, j, ti, tj),
+	// the only rows with a nonzero B
+	std::vector<interp_line_t> seam_rows;
+	std::vector<std::array<int, 4>> seam_pixels;
+	// kept for the next run as long as the geometry does not change; the
+	// key only picks the candidate, the z_index, canvas and mode it was
+	// built from are compared exactly
+	uint64_t geometry_key = 0;
+	std::shared_ptr<image_t> geometry_z;
+	int geometry_width = 0, geometry_height = 0;
+	bool geometry_full = false;
+	std::unique_ptr<linear_solver_t> solver;
 
-	void apply_gradient_matrix(const std::vector<interp_line_t>& S, const std::vector<double> B[3], int size);
 	void build_mixed_image();
 	void build_boundary();
 	void build_matrices();
-	void build_full_matrices();
-	interp_line_t build_interp_line(int x, int y);
+	void build_vectors();
+	uint64_t geometry_fingerprint(bool full_keypoints) const;
+	bool same_geometry(uint64_t key, bool full_keypoints) const;
+	void build_full_vectors();
+	void build_corners();
+	std::vector<std::vector<int>> build_keypoint_aggregates(int coarsest);
+	Eigen::SparseMatrix<double> build_keypoint_prolongation();
+	void leaf_element(const quadtree_t::node_t &n, double K[4][4]);
+	bool seam_gradient(int i, int j, int ti, int tj, double g[3]);
+	static void subtract_lines(const interp_line_t &a, const interp_line_t &b, interp_line_t &out);
+	void build_interp_line(int x, int y, interp_line_t &line);
+	static void corner_bilinear(const quadtree_t::node_t &n, int x, int y, double W[4]);
+	template<typename Callback>
+	void traverse_delta(const block_t &x, bool full_keypoints, const Callback &callback);
 	uint8_t get_color(int x, int y, int ch, int ignore_z);
 
 private:
 	std::vector<std::shared_ptr<layer_t>> layers;
+	solver_options_t solver_options;
+	profiler_t profiler;
 
 public:
+	// the quadtree, matrices and solver of the last run stay cached, a run
+	// with the same masks, offsets and canvas only rebuilds StB and solves
 	void run(bool full_keypoings = false);
+	// a new solver is set up on the next run
+	void set_solver_options(const solver_options_t &options);
 	void save_quadtree(const char *path);
 	void save_image(const char *path);
 	void save_mixed_image(const char *path);
 	void save_delta_image(const char *path);
+	// the composited image of the last run
+	std::shared_ptr<image_t> get_result() const { return img_result; }
 	void set_image_size(int w, int h);
 	void auto_image_size();
 	void add_layer(const char *image, const char *mask, int offset_x = 0, int offset_y = 0);
+	// the same for images in memory, the layer keeps a reference to image
+	void add_layer(std::shared_ptr<image_t> image, image_t *mask, int offset_x = 0, int offset_y = 0);
+	void clear_layers();
+	// phases and counters of the loads, runs and saves so far, runs add
+	// up until profile().clear()
+	profiler_t &profile() { return profiler; }
 };
 
 #endif
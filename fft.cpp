@@ -0,0 +1,148 @@
+#include "fft.h"
+#include <cmath>
+
+fft_t::fft_t(int n) : n(n)
+{
+	m = 1;
+	while(m < n) m <<= 1;
+	if(m != n)
+		while(m < 2 * n - 1) m <<= 1;
+
+	int bits = 0;
+	while((1 << bits) < m) ++bits;
+	reversal.resize(m);
+	for(int i = 0; i < m; ++i)
+	{
+		int r = 0;
+		for(int b = 0; b < bits; ++b)
+			if(i >> b & 1) r |= 1 << (bits - 1 - b);
+		reversal[i] = r;
+	}
+
+	twiddle.resize(m / 2);
+	for(int k = 0; k < m / 2; ++k)
+		twiddle[k] = std::polar(1.0, -2.0 * M_PI * k / m);
+
+	if(m == n)
+		return;
+
+	// k^2 mod 2n keeps the angle exact for large k
+	chirp.resize(n);
+	for(int k = 0; k < n; ++k)
+		chirp[k] = std::polar(1.0, -M_PI * (double)((long long)k * k % (2ll * n)) / n);
+
+	filter.assign(m, 0.0);
+	filter[0] = std::conj(chirp[0]);
+	for(int k = 1; k < n; ++k)
+		filter[k] = filter[m - k] = std::conj(chirp[k]);
+	radix2(filter.data(), false);
+}
+
+void fft_t::radix2(complex_t *a, bool inverse) const
+{
+	for(int i = 0; i < m; ++i)
+		if(i < reversal[i])
+			std::swap(a[i], a[reversal[i]]);
+
+	for(int len = 2; len <= m; len <<= 1)
+	{
+		int step = m / len;
+		for(int i = 0; i < m; i += len)
+		{
+			for(int k = 0; k < len / 2; ++k)
+			{
+				// spelled out, a complex product also checks for NaN otherwise
+				const complex_t &w = twiddle[k * step], &z = a[i + k + len / 2];
+				double wi = inverse ? -w.imag() : w.imag();
+				complex_t u = a[i + k], v(z.real() * w.real() - z.imag() * wi, z.real() * wi + z.imag() * w.real());
+				a[i + k] = u + v;
+				a[i + k + len / 2] = u - v;
+			}
+		}
+	}
+}
+
+void fft_t::transform(complex_t *a, bool inverse, std::vector<complex_t> &work) const
+{
+	if(m == n)
+	{
+		radix2(a, inverse);
+		return;
+	}
+
+	// X_k = conj(c_k) sum_j (x_j conj(c_j)) c_{k - j} with c_k = e^{pi i k^2 / n},
+	// the inverse is the conjugate of the forward transform of the conjugate
+	work.assign(m, 0.0);
+	for(int j = 0; j < n; ++j)
+		work[j] = (inverse ? std::conj(a[j]) : a[j]) * chirp[j];
+	radix2(work.data(), false);
+	for(int k = 0; k < m; ++k)
+		work[k] *= filter[k];
+	radix2(work.data(), true);
+	for(int k = 0; k < n; ++k)
+	{
+		complex_t v = work[k] * chirp[k] / (double)m;
+		a[k] = inverse ? std::conj(v) : v;
+	}
+}
+
+dct_t::dct_t(int n) : fft(n), shift(n)
+{
+	for(int k = 0; k < n; ++k)
+		shift[k] = std::polar(1.0, -M_PI * k / (2.0 * n));
+}
+
+void dct_t::forward(double *x, double *y, fft_work_t &work) const
+{
+	// even samples in order followed by odd samples reversed
+	const int n = size();
+	std::vector<complex_t> &v = work.data;
+	v.resize(n);
+	for(int j = 0; 2 * j < n; ++j)
+		v[j] = complex_t(x[2 * j], y ? y[2 * j] : 0.0);
+	for(int j = 0; 2 * j + 1 < n; ++j)
+		v[n - 1 - j] = complex_t(x[2 * j + 1], y ? y[2 * j + 1] : 0.0);
+	fft.transform(v.data(), false, work.scratch);
+
+	// the transforms of the real and imaginary parts are the even and odd
+	// parts of v_k against conj(v_{n - k})
+	for(int k = 0; 2 * k <= n; ++k)
+	{
+		int l = (n - k) % n;
+		complex_t a = v[k], b = std::conj(v[l]);
+		complex_t vx = 0.5 * (a + b), vy = complex_t(0.0, -0.5) * (a - b);
+		x[k] = (vx * shift[k]).real();
+		x[l] = (std::conj(vx) * shift[l]).real();
+		if(y)
+		{
+			y[k] = (vy * shift[k]).real();
+			y[l] = (std::conj(vy) * shift[l]).real();
+		}
+	}
+}
+
+void dct_t::inverse(double *x, double *y, fft_work_t &work) const
+{
+	const int n = size();
+	std::vector<complex_t> &v = work.data;
+	v.resize(n);
+	v[0] = complex_t(x[0], y ? y[0] : 0.0);
+	for(int k = 1; k < n; ++k)
+	{
+		complex_t vx = std::conj(shift[k]) * complex_t(x[k], -x[n - k]);
+		complex_t vy = y ? std::conj(shift[k]) * complex_t(y[k], -y[n - k]) : 0.0;
+		v[k] = vx + complex_t(0.0, 1.0) * vy;
+	}
+	fft.transform(v.data(), true, work.scratch);
+
+	for(int j = 0; 2 * j < n; ++j)
+	{
+		x[2 * j] = v[j].real() / n;
+		if(y) y[2 * j] = v[j].imag() / n;
+	}
+	for(int j = 0; 2 * j + 1 < n; ++j)
+	{
+		x[2 * j + 1] = v[n - 1 - j].real() / n;
+		if(y) y[2 * j + 1] = v[n - 1 - j].imag() / n;
+	}
+}
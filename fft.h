@@ -0,0 +1,59 @@
+#ifndef __FFT_H__
+#define __FFT_H__
+
+#include <complex>
+#include <vector>
+
+/*
+ * Complex FFT of a fixed length. Powers of two use an iterative radix-2
+ * transform, other lengths Bluestein's algorithm, a convolution with a
+ * chirp done by radix-2 transforms of at least twice the length. A plan is
+ * read-only once built, every thread passes its own work buffer.
+ */
+class fft_t
+{
+	using complex_t = std::complex<double>;
+
+	int n, m;                        // length, and radix-2 length of the convolution
+	std::vector<complex_t> twiddle;  // e^{-2 pi i k / m}, k < m / 2
+	std::vector<int> reversal;       // bit reversal permutation of m
+	std::vector<complex_t> chirp;    // e^{-pi i k^2 / n}, Bluestein only
+	std::vector<complex_t> filter;   // transform of the conjugate chirp, Bluestein only
+
+	void radix2(complex_t *a, bool inverse) const;
+public:
+	explicit fft_t(int n);
+
+	int size() const { return n; }
+	// unnormalized, the inverse transform uses e^{+2 pi i jk / n}
+	void transform(complex_t *a, bool inverse, std::vector<complex_t> &work) const;
+};
+
+// scratch space of one thread
+struct fft_work_t
+{
+	std::vector<std::complex<double>> data, scratch;
+};
+
+/*
+ * Unnormalized DCT-II, X_k = sum_j x_j cos(pi k (2j + 1) / 2n), and its
+ * exact inverse, both by one complex FFT of the same length (Makhoul).
+ * The FFT input is real, so two sequences share one transform as its real
+ * and imaginary parts.
+ */
+class dct_t
+{
+	using complex_t = std::complex<double>;
+
+	fft_t fft;
+	std::vector<complex_t> shift;  // e^{-pi i k / 2n}
+public:
+	explicit dct_t(int n);
+
+	int size() const { return fft.size(); }
+	// in place on the n values of x, and of y unless it is null
+	void forward(double *x, double *y, fft_work_t &work) const;
+	void inverse(double *x, double *y, fft_work_t &work) const;
+};
+
+#endif
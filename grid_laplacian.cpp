@@ -0,0 +1,170 @@
+#include "grid_laplacian.h"
+#include "parallel.h"
+#include <algorithm>
+#include <vector>
+
+Eigen::VectorXd grid_laplacian_t::diagonal() const
+{
+	Eigen::VectorXd d(rows());
+	for(int i = 0; i < height; ++i)
+		for(int j = 0; j < width; ++j)
+			d[i * width + j] = (i > 0) + (i + 1 < height) + (j > 0) + (j + 1 < width);
+	d[rows() - 1] += 1.0;
+	return d;
+}
+
+namespace
+{
+
+template<typename Block>
+void apply_stencil(int width, int height, const Block &x, Block &y)
+{
+	using scalar = typename Block::Scalar;
+	// each row of pixels is a flat run of 3 * width values, the stencil is
+	// applied as a few straight passes over it
+	const int n = 3 * width;
+	#pragma omp parallel for if(width * height >= parallel_threshold)
+	for(int i = 0; i < height; ++i)
+	{
+		const scalar *xc = x.data() + (size_t)i * n;
+		scalar *yc = y.data() + (size_t)i * n;
+
+		for(int k = 0; k < n; ++k)
+			yc[k] = 0.0;
+		if(i > 0)
+		{
+			const scalar *xu = xc - n;
+			for(int k = 0; k < n; ++k)
+				yc[k] += xc[k] - xu[k];
+		}
+		if(i + 1 < height)
+		{
+			const scalar *xd = xc + n;
+			for(int k = 0; k < n; ++k)
+				yc[k] += xc[k] - xd[k];
+		}
+		for(int k = 3; k < n; ++k)
+			yc[k] += xc[k] - xc[k - 3];
+		for(int k = 0; k + 3 < n; ++k)
+			yc[k] += xc[k] - xc[k + 3];
+	}
+
+	y.row(y.rows() - 1) += x.row(x.rows() - 1);
+}
+
+}
+
+void grid_laplacian_t::apply(const block_t &x, block_t &y) const
+{
+	apply_stencil(width, height, x, y);
+}
+
+void grid_laplacian_t::apply(const block_f_t &x, block_f_t &y) const
+{
+	apply_stencil(width, height, x, y);
+}
+
+Eigen::SparseMatrix<double> grid_laplacian_t::to_sparse() const
+{
+	std::vector<Eigen::Triplet<double>> items;
+	items.reserve((size_t)5 * rows());
+	Eigen::VectorXd d = diagonal();
+	for(int i = 0; i < height; ++i)
+	{
+		for(int j = 0; j < width; ++j)
+		{
+			int p = i * width + j;
+			if(i > 0) items.emplace_back(p, p - width, -1.0);
+			if(j > 0) items.emplace_back(p, p - 1, -1.0);
+			items.emplace_back(p, p, d[p]);
+			if(j + 1 < width) items.emplace_back(p, p + 1, -1.0);
+			if(i + 1 < height) items.emplace_back(p, p + width, -1.0);
+		}
+	}
+
+	Eigen::SparseMatrix<double> A(rows(), rows());
+	A.setFromTriplets(items.begin(), items.end());
+	return A;
+}
+
+namespace
+{
+
+// bilinear interpolation along one axis of n pixels from the pixels
+// min(k * factor, n - 1), a pixel lies between nodes k and k + 1 with
+// k = pixel / factor
+Eigen::SparseMatrix<double> interpolation(int n, int factor)
+{
+	int nodes = (n - 1 + factor - 1) / factor + 1;
+	std::vector<Eigen::Triplet<double>> items;
+	for(int p = 0; p < n; ++p)
+	{
+		int k = std::min(p / factor, nodes - 2);
+		if(k < 0)
+		{
+			items.emplace_back(p, 0, 1.0);
+			continue;
+		}
+		int lo = k * factor, hi = std::min((k + 1) * factor, n - 1);
+		double t = double(p - lo) / (hi - lo);
+		if(t != 1.0) items.emplace_back(p, k, 1.0 - t);
+		if(t != 0.0) items.emplace_back(p, k + 1, t);
+	}
+	Eigen::SparseMatrix<double> P(n, nodes);
+	P.setFromTriplets(items.begin(), items.end());
+	return P;
+}
+
+// the path Laplacian of n pixels with Neumann ends
+Eigen::SparseMatrix<double> path_laplacian(int n)
+{
+	std::vector<Eigen::Triplet<double>> items;
+	for(int p = 0; p + 1 < n; ++p)
+	{
+		items.emplace_back(p, p, 1.0);
+		items.emplace_back(p + 1, p + 1, 1.0);
+		items.emplace_back(p, p + 1, -1.0);
+		items.emplace_back(p + 1, p, -1.0);
+	}
+	Eigen::SparseMatrix<double> L(n, n);
+	L.setFromTriplets(items.begin(), items.end());
+	return L;
+}
+
+// a (x) b, row i * b.rows() + j and column k * b.cols() + l hold a(i, k) b(j, l)
+Eigen::SparseMatrix<double> kron(const Eigen::SparseMatrix<double> &a, const Eigen::SparseMatrix<double> &b)
+{
+	std::vector<Eigen::Triplet<double>> items;
+	items.reserve((size_t)a.nonZeros() * b.nonZeros());
+	for(int k = 0; k < a.outerSize(); ++k)
+		for(Eigen::SparseMatrix<double>::InnerIterator ia(a, k); ia; ++ia)
+			for(int l = 0; l < b.outerSize(); ++l)
+				for(Eigen::SparseMatrix<double>::InnerIterator ib(b, l); ib; ++ib)
+					items.emplace_back(ia.row() * b.rows() + ib.row(), k * b.cols() + l, ia.value() * ib.value());
+	Eigen::SparseMatrix<double> c(a.rows() * b.rows(), a.cols() * b.cols());
+	c.setFromTriplets(items.begin(), items.end());
+	return c;
+}
+
+}
+
+Eigen::SparseMatrix<double> grid_laplacian_t::prolongation(int factor) const
+{
+	// rows of pixels times columns of pixels
+	return kron(interpolation(height, factor), interpolation(width, factor));
+}
+
+Eigen::SparseMatrix<double> grid_laplacian_t::galerkin(int factor) const
+{
+	// A = I (x) L_w + L_h (x) I + e e^T for the pinned last pixel e, and
+	// P = P_h (x) P_w, so P^T A P only needs the products along each axis
+	Eigen::SparseMatrix<double> Ph = interpolation(height, factor), Pw = interpolation(width, factor);
+	Eigen::SparseMatrix<double> Pht = Ph.transpose(), Pwt = Pw.transpose();
+	Eigen::SparseMatrix<double> Mh = Pht * Ph, Mw = Pwt * Pw;
+	Eigen::SparseMatrix<double> Lh = Pht * path_laplacian(height) * Ph, Lw = Pwt * path_laplacian(width) * Pw;
+	Eigen::SparseMatrix<double> C = kron(Mh, Lw) + kron(Lh, Mw);
+
+	// the last pixel is interpolated from the last coarse node alone
+	C.coeffRef(C.rows() - 1, C.cols() - 1) += 1.0;
+	return C;
+}
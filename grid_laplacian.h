@@ -0,0 +1,34 @@
+#ifndef __GRID_LAPLACIAN_H__
+#define __GRID_LAPLACIAN_H__
+
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Sparse>
+#include "block.h"
+
+/*
+ * StS of the full-resolution system without storing it: the 5-point
+ * Laplacian of a width x height pixel grid with Neumann borders, plus one
+ * on the diagonal of the last pixel, whose value is pinned to zero.
+ * Unknowns are the pixels in row-major order.
+ */
+class grid_laplacian_t
+{
+	int width, height;
+public:
+	grid_laplacian_t(int width, int height) : width(width), height(height) {}
+	int rows() const { return width * height; }
+	int get_width() const { return width; }
+	int get_height() const { return height; }
+	Eigen::VectorXd diagonal() const;
+	void apply(const block_t &x, block_t &y) const;
+	void apply(const block_f_t &x, block_f_t &y) const;
+	// the same operator stored explicitly, for the solvers that need the entries
+	Eigen::SparseMatrix<double> to_sparse() const;
+	// bilinear interpolation from the pixels on every factor-th row and
+	// column (and the last ones), columns are those pixels in row-major order
+	Eigen::SparseMatrix<double> prolongation(int factor) const;
+	// P^T A P for P = prolongation(factor), without storing A or A P
+	Eigen::SparseMatrix<double> galerkin(int factor) const;
+};
+
+#endif
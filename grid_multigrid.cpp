@@ -0,0 +1,210 @@
+#include "grid_multigrid.h"
+#include "parallel.h"
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+
+double seconds_since(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+}
+
+grid_multigrid_t::grid_multigrid_t(int width, int height, const multigrid_options_t &options)
+	: options(options)
+{
+	levels.emplace_back();
+	level_t &fine = levels.back();
+	fine.width = width, fine.height = height;
+	fine.wv.assign((size_t)(height - 1) * width, 1.0f);
+	fine.wh.assign((size_t)height * (width - 1), 1.0f);
+	fine.pin = 1.0;
+
+	while((long long)levels.back().width * levels.back().height > options.coarsest)
+	{
+		const level_t &f = levels.back();
+		level_t c;
+		c.width = (f.width + 1) / 2, c.height = (f.height + 1) / 2;
+		c.wv.assign((size_t)(c.height - 1) * c.width, 0.0f);
+		c.wh.assign((size_t)c.height * (c.width - 1), 0.0f);
+		c.pin = f.pin;
+
+		// fine edges between two blocks add up, edges inside a block cancel
+		for(int I = 0; I + 1 < c.height; ++I)
+			for(int J = 0; J < c.width; ++J)
+				for(int j = 2 * J; j < std::min(2 * J + 2, f.width); ++j)
+					c.wv[(size_t)I * c.width + J] += f.wv[(size_t)(2 * I + 1) * f.width + j];
+		for(int I = 0; I < c.height; ++I)
+			for(int J = 0; J + 1 < c.width; ++J)
+				for(int i = 2 * I; i < std::min(2 * I + 2, f.height); ++i)
+					c.wh[(size_t)I * (c.width - 1) + J] += f.wh[(size_t)i * (f.width - 1) + 2 * J + 1];
+
+		levels.push_back(std::move(c));
+	}
+
+	for(level_t &l : levels)
+	{
+		int n = l.width * l.height;
+		l.x.resize(n, 3);
+		l.b.resize(n, 3);
+		l.r.resize(n, 3);
+		l.stats = { l.width, l.height, 0, 0.0, 0.0 };
+		l.smoothing_sum = 0.0;
+		l.smoothing_count = 0;
+	}
+
+	// dense factorization of the coarsest operator
+	const level_t &l = levels.back();
+	int n = l.width * l.height;
+	Eigen::MatrixXd A = Eigen::MatrixXd::Zero(n, n);
+	auto edge = [&](int p, int q, double w) {
+		A(p, p) += w, A(q, q) += w;
+		A(p, q) -= w, A(q, p) -= w;
+	};
+	for(int i = 0; i + 1 < l.height; ++i)
+		for(int j = 0; j < l.width; ++j)
+			edge(i * l.width + j, (i + 1) * l.width + j, l.wv[(size_t)i * l.width + j]);
+	for(int i = 0; i < l.height; ++i)
+		for(int j = 0; j + 1 < l.width; ++j)
+			edge(i * l.width + j, i * l.width + j + 1, l.wh[(size_t)i * (l.width - 1) + j]);
+	A(n - 1, n - 1) += l.pin;
+	coarse.compute(A);
+}
+
+void grid_multigrid_t::residual(const level_t &l, block_t &r)
+{
+	const int w = l.width, h = l.height;
+	#pragma omp parallel for if(w * h >= parallel_threshold)
+	for(int i = 0; i < h; ++i)
+	{
+		for(int j = 0; j < w; ++j)
+		{
+			int p = i * w + j;
+			Eigen::RowVector3d ax = Eigen::RowVector3d::Zero();
+			auto edge = [&](int q, double weight) {
+				ax += weight * (l.x.row(p) - l.x.row(q));
+			};
+			if(i > 0) edge(p - w, l.wv[(size_t)(i - 1) * w + j]);
+			if(i + 1 < h) edge(p + w, l.wv[(size_t)i * w + j]);
+			if(j > 0) edge(p - 1, l.wh[(size_t)i * (w - 1) + j - 1]);
+			if(j + 1 < w) edge(p + 1, l.wh[(size_t)i * (w - 1) + j]);
+			r.row(p) = l.b.row(p) - ax;
+		}
+	}
+
+	r.row(w * h - 1) -= l.pin * l.x.row(w * h - 1);
+}
+
+void grid_multigrid_t::smooth(level_t &l, int sweeps, bool reverse)
+{
+	const int w = l.width, h = l.height;
+	for(int s = 0; s < 2 * sweeps; ++s)
+	{
+		int colour = (s & 1) ^ (int)reverse;
+		#pragma omp parallel for if(w * h >= parallel_threshold)
+		for(int i = 0; i < h; ++i)
+		{
+			for(int j = (i + colour) & 1; j < w; j += 2)
+			{
+				int p = i * w + j;
+				Eigen::RowVector3d sum = l.b.row(p);
+				double diag = p == w * h - 1 ? l.pin : 0.0;
+				auto edge = [&](int q, double weight) {
+					sum += weight * l.x.row(q);
+					diag += weight;
+				};
+				if(i > 0) edge(p - w, l.wv[(size_t)(i - 1) * w + j]);
+				if(i + 1 < h) edge(p + w, l.wv[(size_t)i * w + j]);
+				if(j > 0) edge(p - 1, l.wh[(size_t)i * (w - 1) + j - 1]);
+				if(j + 1 < w) edge(p + 1, l.wh[(size_t)i * (w - 1) + j]);
+				if(diag > 0.0)
+					l.x.row(p) = sum / diag;
+			}
+		}
+	}
+}
+
+void grid_multigrid_t::restrict_to(const level_t &fine, const block_t &r, level_t &coarse)
+{
+	coarse.b.setZero();
+	#pragma omp parallel for if(fine.width * fine.height >= parallel_threshold)
+	for(int I = 0; I < coarse.height; ++I)
+		for(int i = 2 * I; i < std::min(2 * I + 2, fine.height); ++i)
+			for(int j = 0; j < fine.width; ++j)
+				coarse.b.row(I * coarse.width + j / 2) += r.row(i * fine.width + j);
+}
+
+void grid_multigrid_t::prolong_add(const level_t &coarse, level_t &fine) const
+{
+	#pragma omp parallel for if(fine.width * fine.height >= parallel_threshold)
+	for(int i = 0; i < fine.height; ++i)
+		for(int j = 0; j < fine.width; ++j)
+			fine.x.row(i * fine.width + j) += options.correction * coarse.x.row((i / 2) * coarse.width + j / 2);
+}
+
+void grid_multigrid_t::cycle(int k) const
+{
+	level_t &l = levels[k];
+	if(k + 1 == (int)levels.size())
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		l.x = coarse.solve(l.b);
+		l.stats.visits++;
+		l.stats.seconds += seconds_since(t0);
+		return;
+	}
+
+	level_t &c = levels[k + 1];
+	auto t0 = std::chrono::steady_clock::now();
+	double before = l.x.isZero(0.0) ? l.b.norm() : -1.0;
+	smooth(l, options.pre_smooth, false);
+	residual(l, l.r);
+	if(before > 0.0)
+		l.smoothing_sum += l.r.norm() / before, l.smoothing_count++;
+	l.stats.visits++;
+	restrict_to(l, l.r, c);
+	c.x.setZero();
+	l.stats.seconds += seconds_since(t0);
+
+	for(int g = 0; g < (options.w_cycle ? 2 : 1); ++g)
+		cycle(k + 1);
+
+	t0 = std::chrono::steady_clock::now();
+	prolong_add(c, l);
+	smooth(l, options.post_smooth, true);
+	l.stats.seconds += seconds_since(t0);
+}
+
+void grid_multigrid_t::apply(const block_t &r, block_t &z) const
+{
+	levels[0].b = r;
+	levels[0].x.setZero();
+	cycle(0);
+	z = levels[0].x;
+}
+
+std::vector<grid_multigrid_t::level_stats_t> grid_multigrid_t::level_stats() const
+{
+	std::vector<level_stats_t> stats;
+	for(const level_t &l : levels)
+	{
+		stats.push_back(l.stats);
+		if(l.smoothing_count > 0)
+			stats.back().smoothing_factor = l.smoothing_sum / l.smoothing_count;
+	}
+	return stats;
+}
+
+void grid_multigrid_t::reset_stats() const
+{
+	for(level_t &l : levels)
+	{
+		l.stats.visits = 0;
+		l.stats.seconds = 0.0;
+		l.smoothing_sum = 0.0;
+		l.smoothing_count = 0;
+	}
+}
@@ -0,0 +1,66 @@
+#ifndef __GRID_MULTIGRID_H__
+#define __GRID_MULTIGRID_H__
+
+#include <vector>
+#include <eigen3/Eigen/Dense>
+#include "block.h"
+#include "solver.h"
+
+/*
+ * Geometric multigrid for the full-resolution system (grid_laplacian_t).
+ *
+ * Every level is a 5-point operator on a grid given by its edge weights and
+ * the weight of the pinned last pixel. A coarse cell is a 2x2 block of fine
+ * cells (1x2, 2x1 or 1x1 on odd borders), the prolongation copies a coarse
+ * value to its cells and the restriction sums them, and the coarse operator
+ * is the Galerkin product, so coarse edge weights are the sums of the fine
+ * edges between two blocks. Red-black Gauss-Seidel smooths, in reverse
+ * colour order after the coarse correction so that a cycle is symmetric and
+ * can precondition CG. The coarsest grid is solved densely.
+ */
+class grid_multigrid_t
+{
+public:
+	struct level_stats_t
+	{
+		int width, height;
+		int visits;
+		double seconds;           // smoothing, residual and transfers on this level
+		double smoothing_factor;  // mean |r| after / before pre-smoothing from x = 0
+	};
+
+private:
+	struct level_t
+	{
+		int width, height;
+		std::vector<float> wv, wh;  // (i, j)-(i + 1, j) and (i, j)-(i, j + 1) edges
+		double pin;
+		block_t x, b, r;
+		level_stats_t stats;
+		double smoothing_sum;
+		int smoothing_count;    // visits that started from x = 0
+	};
+
+	multigrid_options_t options;
+	mutable std::vector<level_t> levels;
+	Eigen::LLT<Eigen::MatrixXd> coarse;
+
+	static void residual(const level_t &l, block_t &r);
+	static void smooth(level_t &l, int sweeps, bool reverse);
+	static void restrict_to(const level_t &fine, const block_t &r, level_t &coarse);
+	void prolong_add(const level_t &coarse, level_t &fine) const;
+	void cycle(int k) const;
+public:
+	grid_multigrid_t(int width, int height, const multigrid_options_t &options);
+
+	int rows() const { return levels[0].width * levels[0].height; }
+	int level_count() const { return levels.size(); }
+
+	// one cycle on A z = r from z = 0, the preconditioner interface of block_cg
+	void apply(const block_t &r, block_t &z) const;
+
+	std::vector<level_stats_t> level_stats() const;
+	void reset_stats() const;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "grid_poisson.h"
+#include "profile.h"
+#include <algorithm>
+#include <cmath>
+
+grid_poisson_t::grid_poisson_t(int width, int height)
+	: width(width), height(height), rows_dct(width), cols_dct(height)
+{
+	for(int k = 0; k < height; ++k)
+		eigen_row.push_back(2.0 - 2.0 * std::cos(M_PI * k / height));
+	for(int l = 0; l < width; ++l)
+		eigen_col.push_back(2.0 - 2.0 * std::cos(M_PI * l / width));
+}
+
+void grid_poisson_t::solve_channel(std::vector<double> &x) const
+{
+	// two rows or two columns share every FFT, columns are gathered into
+	// buffers of their own
+	auto row = [&](int i) { return i < height ? x.data() + (size_t)i * width : nullptr; };
+	#pragma omp parallel
+	{
+		fft_work_t work;
+		std::vector<double> column[2] = { std::vector<double>(height), std::vector<double>(height) };
+
+		// the spans end before the barriers, the gaps show the imbalance
+		{
+			trace_span_t span("dct rows");
+			#pragma omp for nowait
+			for(int i = 0; i < height; i += 2)
+				rows_dct.forward(row(i), row(i + 1), work);
+		}
+		#pragma omp barrier
+
+		{
+			trace_span_t span("dct columns");
+			#pragma omp for nowait
+			for(int j = 0; j < width; j += 2)
+			{
+				int count = std::min(2, width - j);
+				for(int c = 0; c < count; ++c)
+					for(int i = 0; i < height; ++i)
+						column[c][i] = x[(size_t)i * width + j + c];
+				double *second = count == 2 ? column[1].data() : nullptr;
+				cols_dct.forward(column[0].data(), second, work);
+				for(int c = 0; c < count; ++c)
+				{
+					for(int i = 0; i < height; ++i)
+					{
+						double lambda = eigen_row[i] + eigen_col[j + c];
+						column[c][i] = lambda == 0.0 ? 0.0 : column[c][i] / lambda;
+					}
+				}
+				cols_dct.inverse(column[0].data(), second, work);
+				for(int c = 0; c < count; ++c)
+					for(int i = 0; i < height; ++i)
+						x[(size_t)i * width + j + c] = column[c][i];
+			}
+		}
+		#pragma omp barrier
+
+		{
+			trace_span_t span("inverse dct rows");
+			#pragma omp for nowait
+			for(int i = 0; i < height; i += 2)
+				rows_dct.inverse(row(i), row(i + 1), work);
+		}
+	}
+}
+
+void grid_poisson_t::apply(const block_t &r, block_t &z) const
+{
+	const int n = rows();
+	std::vector<double> x(n);
+	for(int ch = 0; ch < 3; ++ch)
+	{
+		double sum = r.col(ch).sum();
+		for(int p = 0; p < n; ++p)
+			x[p] = r(p, ch);
+		x[n - 1] -= sum;
+		solve_channel(x);
+
+		double shift = sum - x[n - 1];
+		for(int p = 0; p < n; ++p)
+			z(p, ch) = x[p] + shift;
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef __GRID_POISSON_H__
+#define __GRID_POISSON_H__
+
+#include <vector>
+#include "block.h"
+#include "fft.h"
+
+/*
+ * Direct solver of the full-resolution system (grid_laplacian_t). The
+ * Neumann Laplacian L of a width x height grid is diagonalized by the 2D
+ * DCT-II with eigenvalues (2 - 2cos(pi k / height)) + (2 - 2cos(pi l / width)).
+ * With the last pixel pinned, L x = b - s e_last where s is the sum of b,
+ * which is solvable, and the constant left free by L is fixed so that
+ * x_last = s. Exact up to rounding in O(N log N).
+ */
+class grid_poisson_t
+{
+	int width, height;
+	dct_t rows_dct, cols_dct;
+	std::vector<double> eigen_row, eigen_col;
+
+	void solve_channel(std::vector<double> &x) const;
+public:
+	grid_poisson_t(int width, int height);
+
+	int rows() const { return width * height; }
+	// z = A^-1 r, the preconditioner interface of the iterative solvers
+	void apply(const block_t &r, block_t &z) const;
+};
+
+#endif
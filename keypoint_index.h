@@ -0,0 +1,107 @@
+#ifndef __KEYPOINT_INDEX_H__
+#define __KEYPOINT_INDEX_H__
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Maps a keypoint (x, y) to its index. Open addressing with linear
+ * probing over two flat arrays, the packed coordinates and the index,
+ * kept at most half full.
+ */
+class keypoint_index_t
+{
+	static constexpr uint64_t empty = ~0ull;
+
+	std::vector<uint64_t> keys;
+	std::vector<int> values;
+	int count, mask;
+
+	static uint64_t pack(int x, int y)
+	{
+		return (uint64_t)(uint32_t)x << 32 | (uint32_t)y;
+	}
+
+	static uint64_t hash(uint64_t k)
+	{
+		k ^= k >> 33;
+		k *= 0xff51afd7ed558ccdull;
+		k ^= k >> 33;
+		return k;
+	}
+
+	void rehash(int capacity)
+	{
+		std::vector<uint64_t> old_keys(capacity, empty);
+		std::vector<int> old_values(capacity, -1);
+		old_keys.swap(keys);
+		old_values.swap(values);
+		mask = capacity - 1;
+		for(int i = 0; i < (int)old_keys.size(); ++i)
+		{
+			if(old_keys[i] == empty)
+				continue;
+			int s = hash(old_keys[i]) & mask;
+			while(keys[s] != empty) s = (s + 1) & mask;
+			keys[s] = old_keys[i];
+			values[s] = old_values[i];
+		}
+	}
+
+public:
+	keypoint_index_t() : count(0), mask(-1) {}
+
+	void clear()
+	{
+		keys.clear();
+		values.clear();
+		count = 0;
+		mask = -1;
+	}
+
+	void reserve(int n)
+	{
+		int capacity = 16;
+		while(capacity < 2 * n) capacity <<= 1;
+		if(capacity > (int)keys.size())
+			rehash(capacity);
+	}
+
+	void insert(int x, int y, int id)
+	{
+		if(2 * (count + 1) > (int)keys.size())
+			reserve(count + 1);
+		uint64_t k = pack(x, y);
+		int s = hash(k) & mask;
+		while(keys[s] != empty && keys[s] != k) s = (s + 1) & mask;
+		if(keys[s] == empty) ++count;
+		keys[s] = k;
+		values[s] = id;
+	}
+
+	// index of the keypoint at (x, y), -1 if there is none
+	int find(int x, int y) const
+	{
+		if(count == 0)
+			return -1;
+		uint64_t k = pack(x, y);
+		for(int s = hash(k) & mask; keys[s] != empty; s = (s + 1) & mask)
+			if(keys[s] == k)
+				return values[s];
+		return -1;
+	}
+
+	// callback(x, y, id) for every keypoint, in no particular order
+	template<typename Callback>
+	void for_each(const Callback &callback) const
+	{
+		for(int s = 0; s < (int)keys.size(); ++s)
+			if(keys[s] != empty)
+				callback((int)(keys[s] >> 32), (int)(uint32_t)keys[s], values[s]);
+	}
+
+	int size() const { return count; }
+	size_t memory() const { return keys.capacity() * sizeof(uint64_t) + values.capacity() * sizeof(int); }
+};
+
+#endif
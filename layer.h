@@ -33,16 +33,25 @@ public:
 
 	void load(const char *image_path, const char *mask_path)
 	{
-		image = std::make_shared<image_t>(image_path);
-		mask = new uint8_t[image->w * image->h];
-		if(mask_path)
+		auto layer_image = std::make_shared<image_t>(image_path);
+		std::unique_ptr<image_t> mask_image(mask_path ? new image_t(mask_path) : nullptr);
+		load(layer_image, mask_image.get());
+	}
+
+	// an image already in memory, pixels with a mask value above 128 are
+	// inside, no mask keeps all of them
+	void load(std::shared_ptr<image_t> layer_image, image_t *mask_image)
+	{
+		image = layer_image;
+		delete[] mask;
+		mask = new uint8_t[(size_t)image->w * image->h];
+		if(mask_image)
 		{
-			image_t mask_image(mask_path);
 			for(int i = 0; i < image->h; ++i)
 				for(int j = 0; j < image->w; ++j)
-					mask[i * image->w + j] = mask_image.get(i, j, 0) > 128;
+					mask[(size_t)i * image->w + j] = mask_image->get(i, j, 0) > 128;
 		} else {
-			std::memset(mask, 255, image->w * image->h);
+			std::memset(mask, 255, (size_t)image->w * image->h);
 		}
 	}
 
@@ -65,7 +74,7 @@ public:
 		y -= offset_y;
 		if(x < 0 || y < 0 || x >= image->h || y >= image->w)
 			return false;
-		return mask[x * image->w + y];
+		return mask[(size_t)x * image->w + y];
 	}
 
 	uint8_t* get_ptr(int x, int y)
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include "linear_quadtree.h"
+#include "morton.h"
+
+linear_quadtree_t::linear_quadtree_t(const quadtree_t &tree)
+{
+	const node_t &root = tree.nodes[0];
+	xl = root.xl, yl = root.yl, range = root.range;
+
+	// traverse() visits the leaves in Morton order already
+	tree.traverse([&](int xl, int xr, int yl, int yr) {
+		leaves.push_back( { xr - xl, xl, xr, yl, yr, -1 } );
+		keys.push_back(morton::encode(xl - this->xl, yl - this->yl));
+	} );
+
+	// a few directory buckets per leaf
+	int code_bits = 0, leaf_bits = 0;
+	while((1ll << code_bits) < (long long)range * range) ++code_bits;
+	while((1ll << leaf_bits) < (long long)leaves.size()) ++leaf_bits;
+	dir_shift = std::max(0, code_bits - leaf_bits - 2);
+
+	int buckets = ((range * (uint64_t)range - 1) >> dir_shift) + 1;
+	dir.resize(buckets + 1);
+	for(int b = 0, id = 0; b <= buckets; ++b)
+	{
+		while(id < (int)keys.size() && (keys[id] >> dir_shift) < (uint64_t)b)
+			++id;
+		dir[b] = id;
+	}
+}
+
+int linear_quadtree_t::_find(int x, int y) const
+{
+	uint64_t code = morton::encode(x - xl, y - yl);
+	uint64_t b = code >> dir_shift;
+
+	// the leaf may also start in an earlier bucket, in which case the
+	// search comes back empty and the answer is the leaf just before it
+	auto it = std::upper_bound(keys.begin() + dir[b], keys.begin() + dir[b + 1], code);
+	return (it - keys.begin()) - 1;
+}
+
+const linear_quadtree_t::node_t *linear_quadtree_t::find(int x, int y) const
+{
+	if(!in_range(x, y))
+		return nullptr;
+	return &leaves[_find(x, y)];
+}
+
+const linear_quadtree_t::node_t *linear_quadtree_t::find_outer(int x, int y) const
+{
+	if(!(xl <= x && x <= xl + range && yl <= y && y <= yl + range))
+		return nullptr;
+	return &leaves[_find(std::max(x - 1, xl), std::max(y - 1, yl))];
+}
+
+bool linear_quadtree_t::is_keypoint(int x, int y) const
+{
+	const node_t *node = find(x, y);
+	if(node && node->xl == x && node->yl == y)
+	{
+		const node_t *outer = find_outer(x, y);
+		if(outer == nullptr) return false;
+		else return (outer->xr == x && outer->yr == y) || x == 0 || y == 0;
+	} else return false;
+}
@@ -0,0 +1,47 @@
+#ifndef __LINEAR_QUADTREE_H__
+#define __LINEAR_QUADTREE_H__
+
+#include <cstdint>
+#include <vector>
+#include "quadtree.h"
+
+/*
+ * Read-only linear form of a quadtree_t: the leaves sorted by the Morton
+ * code of their upper-left corner. The leaf containing a point is the last
+ * one whose code does not exceed the code of the point, a coarse directory
+ * over the high bits of the code narrows that search to a few leaves.
+ */
+class linear_quadtree_t
+{
+public:
+	using node_t = quadtree_t::node_t;
+
+private:
+	int xl, yl, range;
+	std::vector<uint64_t> keys;
+	std::vector<node_t> leaves;
+	std::vector<int> dir;
+	int dir_shift;
+
+	int _find(int x, int y) const;
+public:
+	linear_quadtree_t(const quadtree_t &tree);
+
+	const node_t *find(int x, int y) const;
+	const node_t *find_outer(int x, int y) const;
+	bool in_range(int x, int y) const { return x >= xl && y >= yl && x < xl + range && y < yl + range; }
+	bool is_keypoint(int x, int y) const;
+	int get_range() const { return range; }
+	int leaf_count() const { return leaves.size(); }
+	int leaf_index(const node_t *leaf) const { return leaf - leaves.data(); }
+	const node_t &leaf(int id) const { return leaves[id]; }
+
+	template<typename Callback>
+	void traverse(const Callback &callback) const
+	{
+		for(const node_t &n : leaves)
+			callback(n.xl, n.xr, n.yl, n.yr);
+	}
+};
+
+#endif
@@ -0,0 +1,438 @@
+#include "linear_solver.h"
+#include "grid_laplacian.h"
+#include "grid_multigrid.h"
+#include "grid_poisson.h"
+#include "sparse_multigrid.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <eigen3/Eigen/SparseCholesky>
+#include <eigen3/Eigen/IterativeLinearSolvers>
+
+namespace
+{
+
+const struct { solver_t solver; const char *name; } solver_names[] = {
+	{ solver_t::automatic, "auto" },
+	{ solver_t::cg, "cg" },
+	{ solver_t::ichol_cg, "ichol-cg" },
+	{ solver_t::ldlt, "ldlt" },
+	{ solver_t::llt, "llt" },
+	{ solver_t::multigrid, "mg" },
+	{ solver_t::multigrid_cg, "mg-cg" },
+	{ solver_t::amg, "amg" },
+	{ solver_t::amg_cg, "amg-cg" },
+	{ solver_t::dct, "dct" },
+};
+
+class incomplete_cholesky_preconditioner_t
+{
+	Eigen::IncompleteCholesky<double, Eigen::Lower, Eigen::AMDOrdering<int>> factor;
+public:
+	explicit incomplete_cholesky_preconditioner_t(const Eigen::SparseMatrix<double> &A) { factor.compute(A); }
+	void apply(const block_t &r, block_t &z) const
+	{
+		for(int ch = 0; ch < 3; ++ch)
+		{
+			Eigen::VectorXd c = r.col(ch);
+			z.col(ch) = factor.solve(c);
+		}
+	}
+};
+
+template<typename Preconditioner>
+void print_levels(const Preconditioner &) {}
+
+void print_levels(const grid_multigrid_t &M)
+{
+	for(const auto &l : M.level_stats())
+		std::printf("  level %5d x %-5d %6d visits %8.3fs smoothing factor %.3f\n",
+			l.width, l.height, l.visits, l.seconds, l.smoothing_factor);
+}
+
+void print_levels(const sparse_multigrid_t &M)
+{
+	for(const auto &l : M.level_stats())
+		std::printf("  level %7d rows %8d nonzeros %6d visits %8.3fs smoothing factor %.3f\n",
+			l.rows, l.nonzeros, l.visits, l.seconds, l.smoothing_factor);
+}
+
+// the level statistics cover one solve, also of a solver kept across runs
+template<typename Preconditioner>
+void reset_levels(const Preconditioner &) {}
+
+void reset_levels(const grid_multigrid_t &M) { M.reset_stats(); }
+void reset_levels(const sparse_multigrid_t &M) { M.reset_stats(); }
+
+// CG, or Richardson iteration when the preconditioner is a solver itself
+template<typename Operator, typename Preconditioner>
+class iterative_solver_t : public linear_solver_t
+{
+	const char *label;
+	Operator A;
+	Preconditioner M;
+	bool krylov;
+	double tolerance;
+	int max_iterations;
+public:
+	template<typename... Args>
+	iterative_solver_t(const char *label, const Operator &A, bool krylov, double tolerance, int max_iterations,
+		Args&&... args)
+		: label(label), A(A), M(std::forward<Args>(args)...), krylov(krylov),
+		  tolerance(tolerance), max_iterations(max_iterations) {}
+
+	const char *name() const override { return label; }
+	solver_stats_t solve(const block_t &b, block_t &x) override
+	{
+		reset_levels(M);
+		if(krylov)
+			return block_cg(A, M, b, x, tolerance, max_iterations);
+		return block_richardson(A, M, b, x, tolerance, max_iterations);
+	}
+	void report() const override { print_levels(M); }
+};
+
+template<typename Factorization>
+class direct_solver_t : public linear_solver_t
+{
+	const char *label;
+	const Eigen::SparseMatrix<double> &A;
+	Factorization factorization;
+public:
+	direct_solver_t(const char *label, const Eigen::SparseMatrix<double> &A) : label(label), A(A)
+	{
+		factorization.compute(A);
+		if(factorization.info() != Eigen::Success)
+			std::printf("%s: the factorization failed\n", label);
+	}
+
+	const char *name() const override { return label; }
+	solver_stats_t solve(const block_t &b, block_t &x) override
+	{
+		Eigen::MatrixXd rhs = b;
+		x = factorization.solve(rhs);
+
+		block_t r(b.rows(), 3);
+		sparse_operator_t(A).apply(x, r);
+		r = b - r;
+		Eigen::RowVector3d rhs_norm2 = block_dot(b, b), residual_norm2 = block_dot(r, r);
+		solver_stats_t stats;
+		for(int ch = 0; ch < 3; ++ch)
+		{
+			stats.iterations[ch] = 0;
+			stats.error[ch] = rhs_norm2[ch] == 0.0 ? 0.0 : std::sqrt(residual_norm2[ch] / rhs_norm2[ch]);
+		}
+		stats.history.emplace_back(stats.error[0], stats.error[1], stats.error[2]);
+		return stats;
+	}
+};
+
+// the grid system with its entries, for the solvers that need them
+class stored_grid_solver_t : public linear_solver_t
+{
+	Eigen::SparseMatrix<double> A;
+	std::unique_ptr<linear_solver_t> solver;
+public:
+	stored_grid_solver_t(const grid_laplacian_t &grid, const solver_options_t &options) : A(grid.to_sparse())
+	{
+		A.makeCompressed();
+		solver = make_solver(A, options);
+	}
+
+	const char *name() const override { return solver->name(); }
+	solver_stats_t solve(const block_t &b, block_t &x) override { return solver->solve(b, x); }
+	void report() const override { solver->report(); }
+};
+
+/*
+ * Solves the Galerkin problem P^T A P on a coarse space first and starts
+ * the solver from the prolongation of that solution. The delta is smooth,
+ * so most of it is already there when the solver starts.
+ */
+class warm_start_solver_t : public linear_solver_t
+{
+	std::unique_ptr<linear_solver_t> solver;
+	Eigen::SparseMatrix<double> P;
+	Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> coarse;
+	double seconds = 0.0;
+public:
+	// coarse_A is P^T A P, A itself is not needed
+	warm_start_solver_t(std::unique_ptr<linear_solver_t> solver, const Eigen::SparseMatrix<double> &P,
+		const Eigen::SparseMatrix<double> &coarse_A)
+		: solver(std::move(solver)), P(P)
+	{
+		coarse.compute(coarse_A);
+	}
+
+	const char *name() const override { return solver->name(); }
+	solver_stats_t solve(const block_t &b, block_t &x) override
+	{
+		auto t = std::chrono::steady_clock::now();
+		Eigen::MatrixXd coarse_b = P.transpose() * b;
+		Eigen::MatrixXd coarse_x = coarse.solve(coarse_b);
+		x = P * coarse_x;
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+		return solver->solve(b, x);
+	}
+	void report() const override
+	{
+		std::printf("  warm start from %d coarse unknowns in %.3fs\n", (int)P.cols(), seconds);
+		solver->report();
+	}
+};
+
+/*
+ * Iterative refinement: the residual b - Ax is computed in double, the
+ * correction solves A d = r with Jacobi-CG on a float copy of the system,
+ * which halves the memory traffic of every iteration. Each step gains
+ * about four digits, until the double residual reaches the tolerance.
+ */
+template<typename Operator, typename FloatOperator>
+class refinement_solver_t : public linear_solver_t
+{
+	Operator A;
+	FloatOperator A_float;
+	jacobi_preconditioner_t M;
+	double tolerance;
+	int max_iterations;
+	int steps = 0;
+public:
+	refinement_solver_t(const Operator &A, const FloatOperator &A_float, double tolerance, int max_iterations)
+		: A(A), A_float(A_float), M(A.diagonal()), tolerance(tolerance), max_iterations(max_iterations) {}
+
+	const char *name() const override { return "mixed-precision cg"; }
+	solver_stats_t solve(const block_t &b, block_t &x) override
+	{
+		// single precision CG stalls a little below this
+		const double inner_tolerance = 1.0e-5;
+		const int max_steps = 20;
+		const int n = A.rows();
+		solver_stats_t stats;
+		Eigen::RowVector3d rhs_norm2 = block_dot(b, b), previous;
+		block_t r(n, 3);
+		block_f_t r_f(n, 3), d_f(n, 3);
+		bool done[3] = { false, false, false };
+		int used = 0;
+		std::fill(stats.iterations, stats.iterations + 3, 0);
+		for(steps = 0; ; ++steps)
+		{
+			A.apply(x, r);
+			block_xpby(b, Eigen::RowVector3d::Constant(-1.0), r);
+			Eigen::RowVector3d residual_norm2 = block_dot(r, r);
+			Eigen::RowVector3d error = (residual_norm2.array() / rhs_norm2.array().max(std::numeric_limits<double>::min())).sqrt().matrix();
+			if(steps == 0)
+				stats.history.push_back(error);
+			else
+				stats.history.back() = error;
+
+			// a channel is done at the tolerance, or once refinement stops gaining
+			bool all = true;
+			for(int ch = 0; ch < 3; ++ch)
+			{
+				bool stalled = steps > 0 && residual_norm2[ch] > 0.25 * previous[ch];
+				if(!done[ch] && (error[ch] <= tolerance || rhs_norm2[ch] == 0.0 || stalled
+					|| steps == max_steps || used >= max_iterations))
+					done[ch] = true;
+				stats.error[ch] = rhs_norm2[ch] == 0.0 ? 0.0 : error[ch];
+				all = all && done[ch];
+			}
+			if(all)
+				break;
+			previous = residual_norm2;
+
+			r_f = r.cast<float>();
+			for(int ch = 0; ch < 3; ++ch)
+				if(done[ch])
+					r_f.col(ch).setZero();
+			// the last step only has to close the remaining gap
+			double gap = 0.0;
+			for(int ch = 0; ch < 3; ++ch)
+				if(!done[ch])
+					gap = std::max(gap, error[ch]);
+			d_f.setZero();
+			solver_stats_t inner = block_cg(A_float, M, r_f, d_f, std::max(inner_tolerance, tolerance / gap),
+				max_iterations - used);
+			x += d_f.cast<double>();
+
+			// the inner history is relative to |r|, rescale it to |b|
+			for(size_t i = 1; i < inner.history.size(); ++i)
+				stats.history.push_back(inner.history[i].cwiseProduct(error));
+			int most = 0;
+			for(int ch = 0; ch < 3; ++ch)
+			{
+				stats.iterations[ch] += done[ch] ? 0 : inner.iterations[ch];
+				most = std::max(most, inner.iterations[ch]);
+			}
+			used += std::max(most, 1);
+		}
+		return stats;
+	}
+	void report() const override { std::printf("  %d refinement steps\n", steps); }
+};
+
+bool is_iterative(solver_t solver)
+{
+	return solver != solver_t::ldlt && solver != solver_t::llt && solver != solver_t::dct;
+}
+
+template<typename Operator, typename Preconditioner, typename... Args>
+std::unique_ptr<linear_solver_t> make_iterative(const solver_options_t &options, const Operator &A, bool krylov,
+	Args&&... args)
+{
+	// the result is rounded to 8 bits, far above what multigrid leaves,
+	// plain CG keeps the tightest tolerance it always had
+	solver_t s = options.solver;
+	double tolerance = options.tolerance > 0.0 ? options.tolerance
+		: s == solver_t::cg || s == solver_t::ichol_cg ? Eigen::NumTraits<double>::epsilon() : 1.0e-10;
+	int max_iterations = options.max_iterations > 0 ? options.max_iterations
+		: s == solver_t::dct ? 1 : krylov ? 2 * A.rows() : 100;
+	return std::unique_ptr<linear_solver_t>(new iterative_solver_t<Operator, Preconditioner>(
+		solver_name(s), A, krylov, tolerance, max_iterations, std::forward<Args>(args)...));
+}
+
+template<typename Operator, typename FloatOperator>
+std::unique_ptr<linear_solver_t> make_refinement(const solver_options_t &options, const Operator &A,
+	const FloatOperator &A_float)
+{
+	// far below the 8-bit rounding of the result; the all-double default
+	// of machine precision costs twice the iterations in float
+	double tolerance = options.tolerance > 0.0 ? options.tolerance : 1.0e-8;
+	int max_iterations = options.max_iterations > 0 ? options.max_iterations : 2 * A.rows();
+	return std::unique_ptr<linear_solver_t>(new refinement_solver_t<Operator, FloatOperator>(
+		A, A_float, tolerance, max_iterations));
+}
+
+}
+
+const char *solver_name(solver_t solver)
+{
+	for(const auto &s : solver_names)
+		if(s.solver == solver)
+			return s.name;
+	return "unknown";
+}
+
+bool parse_solver(const char *name, solver_t &solver)
+{
+	for(const auto &s : solver_names)
+	{
+		if(!std::strcmp(s.name, name))
+		{
+			solver = s.solver;
+			return true;
+		}
+	}
+	return false;
+}
+
+solver_t choose_solver(int rows, long long nonzeros)
+{
+	// a sparse Cholesky factorization of a planar system grows like
+	// n^1.5 with a fill-reducing ordering, AMG-CG like the number of
+	// nonzeros; on grid Laplacians the two take as long at about 25000
+	// unknowns
+	double direct = std::pow((double)rows, 1.5) * ((double)nonzeros / std::max(rows, 1));
+	double iterative = 150.0 * nonzeros;
+	return direct <= iterative ? solver_t::ldlt : solver_t::amg_cg;
+}
+
+std::unique_ptr<linear_solver_t> make_solver(const Eigen::SparseMatrix<double> &A,
+	const solver_options_t &options, const std::vector<std::vector<int>> *aggregates,
+	const Eigen::SparseMatrix<double> *coarse)
+{
+	solver_options_t o = options;
+	if(o.solver == solver_t::automatic)
+		o.solver = choose_solver(A.rows(), A.nonZeros());
+	if(o.solver == solver_t::dct)
+	{
+		std::puts("The DCT solver needs the full-resolution mode, using CG");
+		o.solver = solver_t::cg;
+	}
+	if((o.solver == solver_t::multigrid || o.solver == solver_t::multigrid_cg) && !aggregates)
+		o.solver = o.solver == solver_t::multigrid ? solver_t::amg : solver_t::amg_cg;
+
+	if(o.mixed_precision && o.solver != solver_t::cg)
+	{
+		std::printf("Mixed precision is only implemented for cg, solving %s in double\n", solver_name(o.solver));
+		o.mixed_precision = false;
+	}
+
+	if(o.warm_start && is_iterative(o.solver) && coarse)
+	{
+		solver_options_t cold = o;
+		cold.warm_start = false;
+		Eigen::SparseMatrix<double> coarse_A = Eigen::SparseMatrix<double>(coarse->transpose()) * A * *coarse;
+		return std::unique_ptr<linear_solver_t>(new warm_start_solver_t(make_solver(A, cold, aggregates), *coarse,
+			coarse_A));
+	}
+
+	sparse_operator_t op(A);
+	switch(o.solver)
+	{
+	case solver_t::ldlt:
+		return std::unique_ptr<linear_solver_t>(
+			new direct_solver_t<Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>>>(solver_name(o.solver), A));
+	case solver_t::llt:
+		return std::unique_ptr<linear_solver_t>(
+			new direct_solver_t<Eigen::SimplicialLLT<Eigen::SparseMatrix<double>>>(solver_name(o.solver), A));
+	case solver_t::ichol_cg:
+		return make_iterative<sparse_operator_t, incomplete_cholesky_preconditioner_t>(o, op, true, A);
+	case solver_t::multigrid:
+	case solver_t::multigrid_cg:
+		return make_iterative<sparse_operator_t, sparse_multigrid_t>(o, op, o.solver == solver_t::multigrid_cg,
+			A, *aggregates, o.multigrid);
+	case solver_t::amg:
+	case solver_t::amg_cg:
+		return make_iterative<sparse_operator_t, sparse_multigrid_t>(o, op, o.solver == solver_t::amg_cg,
+			A, o.amg);
+	default:
+		if(o.mixed_precision)
+			return make_refinement(o, op, float_sparse_operator_t(A));
+		return make_iterative<sparse_operator_t, jacobi_preconditioner_t>(o, op, true, A.diagonal());
+	}
+}
+
+std::unique_ptr<linear_solver_t> make_grid_solver(int width, int height, const solver_options_t &options)
+{
+	solver_options_t o = options;
+	if(o.solver == solver_t::automatic)
+		o.solver = solver_t::dct;
+
+	if(o.mixed_precision && o.solver != solver_t::cg)
+	{
+		std::printf("Mixed precision is only implemented for cg, solving %s in double\n", solver_name(o.solver));
+		o.mixed_precision = false;
+	}
+
+	grid_laplacian_t A(width, height);
+	if(o.warm_start && is_iterative(o.solver))
+	{
+		// every factor-th pixel, at most about 16384 of them
+		solver_options_t cold = o;
+		cold.warm_start = false;
+		int factor = std::max(2, (int)std::ceil(std::sqrt(A.rows() / 16384.0)));
+		return std::unique_ptr<linear_solver_t>(new warm_start_solver_t(
+			make_grid_solver(width, height, cold), A.prolongation(factor), A.galerkin(factor)));
+	}
+
+	switch(o.solver)
+	{
+	case solver_t::cg:
+		if(o.mixed_precision)
+			return make_refinement(o, A, A);
+		return make_iterative<grid_laplacian_t, jacobi_preconditioner_t>(o, A, true, A.diagonal());
+	case solver_t::dct:
+		// exact, a single step of the iteration reports its residual
+		return make_iterative<grid_laplacian_t, grid_poisson_t>(o, A, false, width, height);
+	case solver_t::multigrid:
+	case solver_t::multigrid_cg:
+		return make_iterative<grid_laplacian_t, grid_multigrid_t>(o, A, o.solver == solver_t::multigrid_cg,
+			width, height, o.multigrid);
+	default:
+		return std::unique_ptr<linear_solver_t>(new stored_grid_solver_t(A, o));
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef __LINEAR_SOLVER_H__
+#define __LINEAR_SOLVER_H__
+
+#include <memory>
+#include <vector>
+#include <eigen3/Eigen/Sparse>
+#include "block.h"
+#include "solver.h"
+
+struct solver_options_t
+{
+	solver_t solver = solver_t::cg;
+	double tolerance = 0.0;   // relative residual, 0 keeps the default of the solver
+	int max_iterations = 0;   // 0 keeps the default of the solver
+	// iterative solvers start from the solution of a coarser problem
+	bool warm_start = false;
+	// cg iterates in float, refined by residuals computed in double
+	bool mixed_precision = false;
+	multigrid_options_t multigrid;  // grid and quadtree hierarchies
+	// smoothed prolongations need neither W-cycles nor over-correction
+	multigrid_options_t amg = { 2, 2, false, 1.0, 256 };
+};
+
+/*
+ * A solver of A x = b for all three channels, set up once for one matrix.
+ * Direct solvers factorize in the constructor, iterative ones build their
+ * preconditioner there.
+ */
+class linear_solver_t
+{
+public:
+	virtual ~linear_solver_t() {}
+	virtual const char *name() const = 0;
+	// iterative solvers start from the x passed in
+	virtual solver_stats_t solve(const block_t &b, block_t &x) = 0;
+	// prints what the solver gathered on top of solver_stats_t, if anything
+	virtual void report() const {}
+};
+
+const char *solver_name(solver_t solver);
+// parses the names used by solver_name, false if there is no such solver
+bool parse_solver(const char *name, solver_t &solver);
+
+// what solver_t::automatic turns into for a sparse system of this size
+solver_t choose_solver(int rows, long long nonzeros);
+
+// A must be compressed and outlive the solver. aggregates are the coarse
+// spaces of solver_t::multigrid(_cg), which falls back to smoothed
+// aggregation without them. coarse is the prolongation of the warm start,
+// which is skipped without it. solver_t::dct needs the grid.
+std::unique_ptr<linear_solver_t> make_solver(const Eigen::SparseMatrix<double> &A,
+	const solver_options_t &options, const std::vector<std::vector<int>> *aggregates = nullptr,
+	const Eigen::SparseMatrix<double> *coarse = nullptr);
+
+// the full-resolution system of grid_laplacian_t, only stored explicitly
+// for the solvers that need its entries
+std::unique_ptr<linear_solver_t> make_grid_solver(int width, int height, const solver_options_t &options);
+
+#endif
@@ -1,13 +1,70 @@
 #include "composite.h"
+#include "parallel.h"
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
-#include <ctime>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <string>
+#include <vector>
 
 int main(int argc, char *argv[])
 {
-	std::string prefix = argv[1];
+	// usage: composite <directory> [x] [--solver name] [--tolerance t] [--max-iterations n] [--warm-start] [--mixed-precision] [--threads n] [--profile report.json] [--trace trace.json]
+	const char *usage = "usage: %s <directory> [x] [--solver auto|cg|ichol-cg|ldlt|llt|mg|mg-cg|amg|amg-cg|dct]"
+		" [--tolerance t] [--max-iterations n] [--warm-start] [--mixed-precision] [--threads n] [--profile report.json] [--trace trace.json]\n";
+	bool use_full_matrix = false;
+	const char *profile_path = nullptr, *trace_path = nullptr;
+	solver_options_t options;
+	std::vector<const char*> positional;
+	for(int i = 1; i < argc; ++i)
+	{
+		bool has_value = i + 1 < argc;
+		if(!std::strcmp(argv[i], "--solver") && has_value)
+		{
+			if(!parse_solver(argv[++i], options.solver))
+			{
+				std::fprintf(stderr, "unknown solver %s\n", argv[i]);
+				return 1;
+			}
+		} else if(!std::strcmp(argv[i], "--tolerance") && has_value) {
+			options.tolerance = std::atof(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--max-iterations") && has_value) {
+			options.max_iterations = std::atoi(argv[++i]);
+		} else if(!std::strcmp(argv[i], "--warm-start")) {
+			options.warm_start = true;
+		} else if(!std::strcmp(argv[i], "--mixed-precision")) {
+			options.mixed_precision = true;
+		} else if(!std::strcmp(argv[i], "--profile") && has_value) {
+			profile_path = argv[++i];
+		} else if(!std::strcmp(argv[i], "--trace") && has_value) {
+			trace_path = argv[++i];
+		} else if(!std::strcmp(argv[i], "--threads") && has_value) {
+			set_thread_count(std::atoi(argv[++i]));
+		} else if(!std::strncmp(argv[i], "--", 2)) {
+			// a misspelt flag or a missing value must not start a run
+			std::fprintf(stderr, "unknown option or missing value: %s\n", argv[i]);
+			positional.clear();
+			break;
+		} else positional.push_back(argv[i]);
+	}
+
+	if(positional.empty() || positional.size() > 2)
+	{
+		std::fprintf(stderr, usage, argv[0]);
+		return 1;
+	}
+
+	// a second argument after the directory selects the full-resolution mode
+	if(positional.size() == 2) use_full_matrix = true;
+
+	if(profile_path)
+		count_allocations();
+	if(trace_path)
+		start_trace();
+
+	std::string prefix = positional[0];
 	prefix += "/";
 	auto compositor = std::make_shared<image_compositor>();
 
@@ -26,19 +83,28 @@ int main(int argc, char *argv[])
 	}
 
 	compositor->auto_image_size();
+	compositor->set_solver_options(options);
 
-	bool use_full_matrix = false;
-	if(argc == 3) use_full_matrix = true;
-
-	auto t1 = std::clock();
+	// wall time, the solvers run on several threads
+	auto t1 = std::chrono::steady_clock::now();
 	compositor->run(use_full_matrix);
-	auto t2 = std::clock();
+	auto t2 = std::chrono::steady_clock::now();
 
 	compositor->save_delta_image((prefix + "delta.png").c_str());
 	compositor->save_mixed_image((prefix + "mixed.png").c_str());
 	compositor->save_quadtree((prefix + "quadtree.png").c_str());
 	compositor->save_image((prefix + "result.png").c_str());
 
-	std::printf("Elasped time: %.3lfs\n", (t2 - t1) / double(CLOCKS_PER_SEC));
+	std::printf("Elasped time: %.3lfs\n", std::chrono::duration<double>(t2 - t1).count());
+	if(profile_path && !compositor->profile().write_json(profile_path))
+	{
+		std::fprintf(stderr, "cannot write %s\n", profile_path);
+		return 1;
+	}
+	if(trace_path && !write_trace(trace_path))
+	{
+		std::fprintf(stderr, "cannot write %s\n", trace_path);
+		return 1;
+	}
 	return 0;
 }
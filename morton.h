@@ -0,0 +1,39 @@
+#ifndef __MORTON_H__
+#define __MORTON_H__
+
+#include <cstdint>
+
+namespace morton
+{
+
+// spreads the low 32 bits of v to the even bits of the result
+inline uint64_t spread(uint64_t v)
+{
+	v &= 0xffffffffull;
+	v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+	v = (v | (v << 8))  & 0x00ff00ff00ff00ffull;
+	v = (v | (v << 4))  & 0x0f0f0f0f0f0f0f0full;
+	v = (v | (v << 2))  & 0x3333333333333333ull;
+	v = (v | (v << 1))  & 0x5555555555555555ull;
+	return v;
+}
+
+inline uint32_t compact(uint64_t v)
+{
+	v &= 0x5555555555555555ull;
+	v = (v | (v >> 1))  & 0x3333333333333333ull;
+	v = (v | (v >> 2))  & 0x0f0f0f0f0f0f0f0full;
+	v = (v | (v >> 4))  & 0x00ff00ff00ff00ffull;
+	v = (v | (v >> 8))  & 0x0000ffff0000ffffull;
+	v = (v | (v >> 16)) & 0x00000000ffffffffull;
+	return v;
+}
+
+// x takes the odd bits so that codes sort in the ll, lr, rl, rr child order of quadtree_t
+inline uint64_t encode(int x, int y) { return (spread(x) << 1) | spread(y); }
+inline int decode_x(uint64_t code) { return compact(code >> 1); }
+inline int decode_y(uint64_t code) { return compact(code); }
+
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+/*
+ * Parallel loops use OpenMP when it is enabled (-fopenmp) and run
+ * serially otherwise, these wrappers keep the call sites free of #ifdefs.
+ */
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// loops over fewer elements than this run on one thread, waking the
+// others costs more than it saves
+constexpr int parallel_threshold = 16384;
+
+inline int thread_count()
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+inline int thread_id()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+inline void set_thread_count(int threads)
+{
+#ifdef _OPENMP
+	if(threads > 0)
+		omp_set_num_threads(threads);
+#else
+	(void)threads;
+#endif
+}
+
+#endif
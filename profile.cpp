@@ -0,0 +1,216 @@
+#include "profile.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <sys/resource.h>
+
+namespace
+{
+
+std::atomic<bool> counting(false);
+std::atomic<long long> allocations(0), allocation_bytes(0);
+
+struct trace_event_t
+{
+	std::string name;
+	int thread;
+	double start, duration;  // seconds
+};
+
+std::atomic<bool> trace_on(false);
+double trace_epoch = 0.0;
+std::mutex trace_mutex;
+std::vector<trace_event_t> trace_events;
+
+void *counted_alloc(std::size_t size)
+{
+	if(counting.load(std::memory_order_relaxed))
+	{
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+	if(void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+double wall_seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void process_usage(double &cpu, long &peak_rss)
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 1.0e-6 * (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+	peak_rss = usage.ru_maxrss;
+}
+
+void add_trace_event(const std::string &name, double start, double end)
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	trace_events.push_back( { name, thread_id(), start, end - start } );
+}
+
+void write_string(std::FILE *file, const std::string &s)
+{
+	std::fputc('"', file);
+	for(char c : s)
+	{
+		if(c == '"' || c == '\\')
+			std::fprintf(file, "\\%c", c);
+		else if((unsigned char)c < 0x20)
+			std::fprintf(file, "\\u%04x", c);
+		else std::fputc(c, file);
+	}
+	std::fputc('"', file);
+}
+
+}
+
+void *operator new(std::size_t size) { return counted_alloc(size); }
+void *operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+void count_allocations() { counting.store(true, std::memory_order_relaxed); }
+long long allocation_count() { return allocations.load(std::memory_order_relaxed); }
+long long allocated_bytes() { return allocation_bytes.load(std::memory_order_relaxed); }
+
+profiler_t::scope_t::scope_t(profiler_t *profiler, const std::string &name) : profiler(profiler)
+{
+	index = profiler->phases.size();
+	profiler->phases.push_back( { name, profiler->depth++, 0.0, 0.0, 0, 0, 0 } );
+	long peak_rss;
+	process_usage(cpu, peak_rss);
+	allocations = allocation_count();
+	allocated_bytes = ::allocated_bytes();
+	wall = wall_seconds();
+}
+
+profiler_t::scope_t::scope_t(scope_t &&other)
+	: profiler(other.profiler), index(other.index), wall(other.wall), cpu(other.cpu),
+	  allocations(other.allocations), allocated_bytes(other.allocated_bytes)
+{
+	other.profiler = nullptr;
+}
+
+void profiler_t::scope_t::end()
+{
+	if(!profiler)
+		return;
+	phase_record_t &r = profiler->phases[index];
+	r.wall = wall_seconds() - wall;
+	double cpu_now;
+	process_usage(cpu_now, r.peak_rss);
+	r.cpu = cpu_now - cpu;
+	r.allocations = allocation_count() - allocations;
+	r.allocated_bytes = ::allocated_bytes() - allocated_bytes;
+	if(tracing())
+		add_trace_event(r.name, wall, wall + r.wall);
+	--profiler->depth;
+	profiler = nullptr;
+}
+
+void profiler_t::counter(const std::string &name, double value)
+{
+	for(auto &c : counters)
+	{
+		if(c.first == name)
+		{
+			c.second = value;
+			return;
+		}
+	}
+	counters.emplace_back(name, value);
+}
+
+void profiler_t::clear()
+{
+	phases.clear();
+	counters.clear();
+}
+
+bool profiler_t::write_json(const char *path) const
+{
+	std::FILE *file = std::fopen(path, "w");
+	if(!file)
+		return false;
+
+	std::fputs("{\n  \"phases\": [\n", file);
+	for(size_t i = 0; i < phases.size(); ++i)
+	{
+		const phase_record_t &p = phases[i];
+		std::fputs("    { \"name\": ", file);
+		write_string(file, p.name);
+		std::fprintf(file, ", \"depth\": %d, \"wall_s\": %.6f, \"cpu_s\": %.6f, \"peak_rss_kb\": %ld,"
+			" \"allocations\": %lld, \"allocated_bytes\": %lld }%s\n", p.depth, p.wall, p.cpu, p.peak_rss,
+			p.allocations, p.allocated_bytes, i + 1 < phases.size() ? "," : "");
+	}
+	std::fputs("  ],\n  \"counters\": {\n", file);
+	for(size_t i = 0; i < counters.size(); ++i)
+	{
+		std::fputs("    ", file);
+		write_string(file, counters[i].first);
+		std::fprintf(file, ": %.17g%s\n", counters[i].second, i + 1 < counters.size() ? "," : "");
+	}
+	std::fputs("  }\n}\n", file);
+	return std::fclose(file) == 0;
+}
+
+void start_trace()
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	trace_events.clear();
+	trace_epoch = wall_seconds();
+	trace_on = true;
+}
+
+bool tracing()
+{
+	return trace_on.load(std::memory_order_relaxed);
+}
+
+bool write_trace(const char *path)
+{
+	std::FILE *file = std::fopen(path, "w");
+	if(!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	int threads = 1;
+	for(const trace_event_t &e : trace_events)
+		threads = std::max(threads, e.thread + 1);
+
+	// lanes named after the threads, then complete events in microseconds
+	std::fputs("{\"traceEvents\": [\n", file);
+	std::fputs("  { \"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": { \"name\": \"composite\" } }", file);
+	for(int t = 0; t < threads; ++t)
+		std::fprintf(file, ",\n  { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d,"
+			" \"args\": { \"name\": \"thread %d\" } }", t, t);
+	for(const trace_event_t &e : trace_events)
+	{
+		std::fputs(",\n  { \"name\": ", file);
+		write_string(file, e.name);
+		std::fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f }",
+			e.thread, (e.start - trace_epoch) * 1e6, e.duration * 1e6);
+	}
+	std::fputs("\n], \"displayTimeUnit\": \"ms\"}\n", file);
+	return std::fclose(file) == 0;
+}
+
+trace_span_t::trace_span_t(const char *name) : name(name), start(tracing() ? wall_seconds() : -1.0) {}
+
+trace_span_t::~trace_span_t()
+{
+	if(start >= 0.0 && tracing())
+		add_trace_event(name, start, wall_seconds());
+}
@@ -0,0 +1,89 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * What a phase of a run cost: wall and CPU time of the process, the peak
+ * resident set size when it ended, and the allocations made through
+ * operator new while it ran (dense Eigen matrices and stb images are
+ * allocated with malloc and not counted; both are zero unless
+ * count_allocations() was called). Phases nest, depth is the number of
+ * enclosing ones.
+ */
+struct phase_record_t
+{
+	std::string name;
+	int depth;
+	double wall, cpu;        // seconds
+	long peak_rss;           // kilobytes, of the whole process so far
+	long long allocations, allocated_bytes;
+};
+
+// Phases and counters are only ever appended: a profiler kept across
+// several runs, like the one of an image_compositor, holds all of them
+// until clear().
+class profiler_t
+{
+	std::vector<phase_record_t> phases;
+	std::vector<std::pair<std::string, double>> counters;
+	int depth = 0;
+
+public:
+	// measures from its construction to end() or its destruction
+	class scope_t
+	{
+		profiler_t *profiler;
+		size_t index;
+		double wall, cpu;
+		long long allocations, allocated_bytes;
+	public:
+		scope_t(profiler_t *profiler, const std::string &name);
+		scope_t(scope_t &&other);
+		scope_t(const scope_t &) = delete;
+		~scope_t() { end(); }
+		void end();
+	};
+
+	scope_t phase(const std::string &name) { return scope_t(this, name); }
+	// sets a counter, the last value of a name wins
+	void counter(const std::string &name, double value);
+	void clear();
+
+	const std::vector<phase_record_t> &get_phases() const { return phases; }
+	const std::vector<std::pair<std::string, double>> &get_counters() const { return counters; }
+	bool write_json(const char *path) const;
+};
+
+// operator new counts nothing until count_allocations(), from then on
+// every allocation of the process, at the cost of two atomic adds each
+void count_allocations();
+long long allocation_count();
+long long allocated_bytes();
+
+/*
+ * A timeline in the trace event format of chrome://tracing and Perfetto.
+ * Off until start_trace(); from then on every profiler phase and every
+ * trace_span_t, on any thread, becomes a span on the lane of its OpenMP
+ * thread.
+ */
+void start_trace();
+bool tracing();
+// the spans so far, false if the file cannot be written
+bool write_trace(const char *path);
+
+class trace_span_t
+{
+	const char *name;
+	double start;
+public:
+	// name must outlive the span, spans are cheap while not tracing
+	explicit trace_span_t(const char *name);
+	trace_span_t(const trace_span_t &) = delete;
+	~trace_span_t();
+};
+
+#endif
@@ -2,122 +2,163 @@
 #include <cstdio>
 #include <algorithm>
 #include "quadtree.h"
+#include "morton.h"
 #include "image.h"
 
 quadtree_t::quadtree_t(int xl, int xr, int yl, int yr)
-	: xl(xl), xr(xr), yl(yl), yr(yr)
 {
-	range = xr - xl;
-	s_ll = s_lr = s_rl = s_rr = nullptr;
+	_init(xl, xr, yl, yr);
 }
 
-quadtree_t::~quadtree_t()
+void quadtree_t::_init(int xl, int xr, int yl, int yr)
 {
-	if(!is_leaf())
-	{
-		delete s_ll;
-		delete s_lr;
-		delete s_rl;
-		delete s_rr;
-	}
-}
-
-bool quadtree_t::is_leaf()
-{
-    return s_ll == nullptr;
-}
-
-bool quadtree_t::in_range(int x, int y)
-{
-	return x >= xl && y >= yl && x < xr && y < yr;
+	nodes.clear();
+	nodes.push_back( { xr - xl, xl, xr, yl, yr, -1 } );
 }
 
-quadtree_t *quadtree_t::find(int x, int y)
+bool quadtree_t::is_keypoint(int x, int y) const
 {
-	if(!in_range(x, y))
-		return nullptr;
-	if(is_leaf()) return this;
-	return _find_child(x, y)->find(x, y);
-}
-
-bool quadtree_t::is_keypoint(int x, int y)
-{
-	quadtree_t *node = find(x, y);
+	const node_t *node = find(x, y);
 	if(node && node->xl == x && node->yl == y)
 	{
-		quadtree_t *outer = find_outer(x, y);
+		const node_t *outer = find_outer(x, y);
 		if(outer == nullptr) return false;
-		else return outer->xr == x && outer->yr == y || x == 0 || y == 0;
+		else return (outer->xr == x && outer->yr == y) || x == 0 || y == 0;
 	} else return false;
 }
 
-quadtree_t* quadtree_t::find_outer(int x, int y)
+const quadtree_t::node_t* quadtree_t::find_outer(int x, int y) const
 {
-	if(xl <= x && x <= xr && yl <= y && y <= yr)
-	{
-		if(is_leaf())
-			return this;
-		int xm = (xl + xr) >> 1, ym = (yl + yr) >> 1;
-		quadtree_t *s;
-		if(x <= xm) s = y <= ym ? s_ll : s_lr;
-		else s = y <= ym ? s_rl : s_rr;
-		return s->find_outer(x, y);
-	} else return nullptr;
+	// same as find() except that the ranges are closed and ties go to the
+	// lower child, i.e. the leaf containing (x - 1, y - 1) clamped to the root
+	const node_t &root = nodes[0];
+	if(!(root.xl <= x && x <= root.xr && root.yl <= y && y <= root.yr))
+		return nullptr;
+	return &nodes[_find(std::max(x - 1, root.xl), std::max(y - 1, root.yl))];
 }
 
-quadtree_t *quadtree_t::_find_child(int x, int y)
+int quadtree_t::_find_child(int id, int x, int y) const
 {
-	int xm = (xl + xr) >> 1, ym = (yl + yr) >> 1;
-
-	quadtree_t *s;
-	if(x < xm) s = y < ym ? s_ll : s_lr;
-	else s = y < ym ? s_rl : s_rr;
-	return s;
+	const node_t &n = nodes[id];
+	int xm = (n.xl + n.xr) >> 1, ym = (n.yl + n.yr) >> 1;
+	return n.child + (x < xm ? 0 : 2) + (y < ym ? 0 : 1);
 }
 
-void quadtree_t::_split()
+void quadtree_t::_split(int id)
 {
-	int xm = (xl + xr) >> 1, ym = (yl + yr) >> 1;
-	s_ll = new quadtree_t(xl, xm, yl, ym);
-	s_lr = new quadtree_t(xl, xm, ym, yr);
-	s_rl = new quadtree_t(xm, xr, yl, ym);
-	s_rr = new quadtree_t(xm, xr, ym, yr);
+	// copy the node first, pushing children may reallocate the arena
+	node_t n = nodes[id];
+	int xm = (n.xl + n.xr) >> 1, ym = (n.yl + n.yr) >> 1, r = n.range >> 1;
+	int child = nodes.size();
+	nodes.push_back( { r, n.xl, xm, n.yl, ym, -1 } );
+	nodes.push_back( { r, n.xl, xm, ym, n.yr, -1 } );
+	nodes.push_back( { r, xm, n.xr, n.yl, ym, -1 } );
+	nodes.push_back( { r, xm, n.xr, ym, n.yr, -1 } );
+	nodes[id].child = child;
 }
 
-void quadtree_t::_split_tree(quadtree_t *root, int x, int y, int range)
+void quadtree_t::_split_tree(int x, int y, int range)
 {
-	auto sub_split = [=](int x, int y, int range) {
-		quadtree_t *n = root->find(x, y);
-		if(n && n->range > range)
-			_split_tree(root, x, y, range);
+	auto sub_split = [this](int x, int y, int range) {
+		int n = _find(x, y);
+		if(n >= 0 && nodes[n].range > range)
+			_split_tree(x, y, range);
 	};
-	quadtree_t *now = root;
-	while(now->range > range)
+	int now = 0;
+	while(nodes[now].range > range)
 	{
-		if(now->is_leaf())
+		if(nodes[now].is_leaf())
 		{
-			now->_split();
-			sub_split(now->xl - 1, now->yl, now->range);
-			sub_split(now->xl, now->yl - 1, now->range);
-			sub_split(now->xr, now->yl, now->range);
-			sub_split(now->xl, now->yr, now->range);
+			_split(now);
+			node_t n = nodes[now];
+			sub_split(n.xl - 1, n.yl, n.range);
+			sub_split(n.xl, n.yl - 1, n.range);
+			sub_split(n.xr, n.yl, n.range);
+			sub_split(n.xl, n.yr, n.range);
 		}
 
-		now = now->_find_child(x, y);
+		now = _find_child(now, x, y);
 	}
 }
 
 void quadtree_t::split(int x, int y, int range)
 {
-	_split_tree(this, x, y, range);
-	if(x > xl && y > yl)
-		_split_tree(this, x - 1, y - 1, range);
+	_split_tree(x, y, range);
+	if(x > nodes[0].xl && y > nodes[0].yl)
+		_split_tree(x - 1, y - 1, range);
+}
+
+void quadtree_t::build(const std::vector<std::pair<int, int>> &points)
+{
+	node_t root = nodes[0];
+	_init(root.xl, root.xr, root.yl, root.yr);
+	int levels = 0;
+	while((1 << levels) < root.range) ++levels;
+
+	// (1) bottom-up: internal[l] gets the Morton codes of the nodes of side
+	// 2^l that are split. These are the parents of the required unit cells,
+	// the parents of the internal nodes of the level below and the parents
+	// of their edge neighbours, which must exist to keep the tree balanced.
+	std::vector<std::vector<uint64_t>> internal(levels + 1);
+	std::vector<uint64_t> cells;
+	cells.reserve(points.size() * 2);
+	for(auto p : points)
+	{
+		int x = p.first - root.xl, y = p.second - root.yl;
+		cells.push_back(morton::encode(x, y) >> 2);
+		if(x > 0 && y > 0)
+			cells.push_back(morton::encode(x - 1, y - 1) >> 2);
+	}
+
+	int internal_count = 0;
+	for(int l = 1; l <= levels && !cells.empty(); ++l)
+	{
+		std::sort(cells.begin(), cells.end());
+		cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+		internal[l].swap(cells);
+		internal_count += internal[l].size();
+
+		int side = root.range >> l;
+		cells.clear();
+		for(uint64_t c : internal[l])
+		{
+			int x = morton::decode_x(c), y = morton::decode_y(c);
+			cells.push_back(c >> 2);
+			if(x > 0) cells.push_back(morton::encode(x - 1, y) >> 2);
+			if(y > 0) cells.push_back(morton::encode(x, y - 1) >> 2);
+			if(x + 1 < side) cells.push_back(morton::encode(x + 1, y) >> 2);
+			if(y + 1 < side) cells.push_back(morton::encode(x, y + 1) >> 2);
+		}
+	}
+
+	// (2) top-down: split the marked nodes level by level, the nodes of a
+	// level are produced in Morton order so the marks are merged linearly
+	nodes.reserve(1 + 4 * internal_count);
+	std::vector<int> now = { 0 }, next;
+	for(int l = levels; l >= 1 && !now.empty(); --l)
+	{
+		next.clear();
+		auto it = internal[l].begin();
+		for(int id : now)
+		{
+			const node_t &n = nodes[id];
+			uint64_t c = morton::encode(n.xl - root.xl, n.yl - root.yl) >> (2 * l);
+			while(it != internal[l].end() && *it < c) ++it;
+			if(it != internal[l].end() && *it == c)
+			{
+				_split(id);
+				for(int k = 0; k < 4; ++k)
+					next.push_back(nodes[id].child + k);
+			}
+		}
+		now.swap(next);
+	}
 }
 
 void quadtree_t::dump_to(const char *filename, int width, int height)
 {
-	if(width == 0) width = range;
-	if(height == 0) height = range;
+	if(width == 0) width = get_range();
+	if(height == 0) height = get_range();
 	image_t img(width, height);
 	traverse([&](int xl, int xr, int yl, int yr) {
 		xr = std::min(xr, height - 1);
@@ -151,20 +192,22 @@ quadtree_t::quadtree_t(const char* boundary_filename)
 	// initialize
 	image_t img(boundary_filename);
 	int w = img.w, h = img.h;
-	xl = yl = 0;
-	range = xr = yr = std::max(get_2pow(h), get_2pow(w));
-	s_ll = s_lr = s_rl = s_rr = nullptr;
+	int range = std::max(get_2pow(h), get_2pow(w));
+	_init(0, range, 0, range);
 
 	// split
+	std::vector<std::pair<int, int>> points;
 	for(int i = 0; i < w; ++i)
-		split(h - 1, i, 1);
+		points.emplace_back(h - 1, i);
 	for(int i = 0; i < h; ++i)
-		split(i, w - 1, 1);
+		points.emplace_back(i, w - 1);
 
 	for(int i = 0; i < h; ++i)
 		for(int j = 0; j < w; ++j)
 		{
 			if(img.get(i, j, 0) < 128)
-				split(i, j, 1);
+				points.emplace_back(i, j);
 		}
+
+	build(points);
 }
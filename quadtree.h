@@ -1,42 +1,83 @@
 #ifndef __QUADTREE_H__
 #define __QUADTREE_H__
 
+#include <utility>
+#include <vector>
+
 class quadtree_t
 {
 	friend class image_compositor;
-    int range;
-    int xl, xr, yl, yr;
-    quadtree_t *s_ll, *s_lr, *s_rl, *s_rr;
+	friend class linear_quadtree_t;
+public:
+    struct node_t
+    {
+        int range;
+        int xl, xr, yl, yr;
+        int child;  // index of the first of four contiguous children, -1 for a leaf
+
+        bool in_range(int x, int y) const { return x >= xl && y >= yl && x < xr && y < yr; }
+        bool is_leaf() const { return child < 0; }
+        int get_range() const { return range; }
+    };
+
+private:
+    // all nodes live in one arena, children of a node are stored
+    // consecutively in the order ll, lr, rl, rr
+    std::vector<node_t> nodes;
 
-    void _split();
-    static void _split_tree(quadtree_t *root, int x, int y, int range);
-    quadtree_t *_find_child(int x, int y);
+    void _init(int xl, int xr, int yl, int yr);
+    void _split(int id);
+    void _split_tree(int x, int y, int range);
+    int _find(int x, int y) const
+    {
+        if(!in_range(x, y))
+            return -1;
+        // the root range is a power of two, so the quadrant on every
+        // level is just one bit of the offset into the root
+        const node_t *base = nodes.data();
+        int dx = x - base->xl, dy = y - base->yl, id = 0;
+        for(int h = base->range >> 1; base[id].child >= 0; h >>= 1)
+            id = base[id].child + ((dx & h) ? 2 : 0) + ((dy & h) ? 1 : 0);
+        return id;
+    }
+    int _find_child(int id, int x, int y) const;
 public:
+    // the side of the root (xr - xl == yr - yl) must be a power of two
     quadtree_t(int xl, int xr, int yl, int yr);
     quadtree_t(const char *boundary_filename);
-    ~quadtree_t();
 
     void split(int x, int y, int range = 1);
-    quadtree_t *find(int x, int y);
-    quadtree_t *find_outer(int x, int y);
-	bool in_range(int x, int y);
-    bool is_leaf();
-	bool is_keypoint(int x, int y);
-	int get_range() { return range; }
+    // rebuilds the tree in one pass as if split(x, y, 1) was called for every point
+    void build(const std::vector<std::pair<int, int>> &points);
+    const node_t *find(int x, int y) const
+    {
+        int id = _find(x, y);
+        return id < 0 ? nullptr : &nodes[id];
+    }
+    const node_t *find_outer(int x, int y) const;
+	bool in_range(int x, int y) const { return nodes[0].in_range(x, y); }
+	bool is_keypoint(int x, int y) const;
+	int get_range() const { return nodes[0].range; }
+	int node_count() const { return nodes.size(); }
 
 	void dump_to(const char* filename, int width, int height);
 
     template<typename Callback>
-    void traverse(const Callback &callback)
+    void traverse(const Callback &callback) const
     {
-        if(is_leaf())
+        int stack[64 * 3], top = 0;
+        stack[top++] = 0;
+        while(top)
         {
-            callback(xl, xr, yl, yr);
-        } else {
-            s_ll->traverse(callback);
-            s_lr->traverse(callback);
-            s_rl->traverse(callback);
-            s_rr->traverse(callback);
+            const node_t &n = nodes[stack[--top]];
+            if(n.is_leaf())
+            {
+                callback(n.xl, n.xr, n.yl, n.yr);
+            } else {
+                // push in reverse so that leaves are visited in the ll, lr, rl, rr order
+                for(int k = 3; k >= 0; --k)
+                    stack[top++] = n.child + k;
+            }
         }
     }
 };
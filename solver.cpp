@@ -0,0 +1,136 @@
+#include "solver.h"
+#include "parallel.h"
+
+namespace
+{
+
+template<typename Block>
+Eigen::RowVector3d dot(const Block &a, const Block &b)
+{
+	double s0 = 0.0, s1 = 0.0, s2 = 0.0;
+	const auto *pa = a.data(), *pb = b.data();
+	const int n = a.rows();
+	#pragma omp parallel for reduction(+:s0, s1, s2) if(n >= parallel_threshold)
+	for(int i = 0; i < n; ++i)
+	{
+		s0 += (double)pa[3 * i] * pb[3 * i];
+		s1 += (double)pa[3 * i + 1] * pb[3 * i + 1];
+		s2 += (double)pa[3 * i + 2] * pb[3 * i + 2];
+	}
+	return Eigen::RowVector3d(s0, s1, s2);
+}
+
+template<typename Block>
+void axpy(const Eigen::RowVector3d &alpha, const Block &x, Block &y)
+{
+	using scalar = typename Block::Scalar;
+	const scalar *px = x.data();
+	scalar *py = y.data();
+	const int n = 3 * x.rows();
+	const scalar a[3] = { (scalar)alpha[0], (scalar)alpha[1], (scalar)alpha[2] };
+	#pragma omp parallel for if(n >= 3 * parallel_threshold)
+	for(int i = 0; i < n; i += 3)
+	{
+		py[i] += a[0] * px[i];
+		py[i + 1] += a[1] * px[i + 1];
+		py[i + 2] += a[2] * px[i + 2];
+	}
+}
+
+template<typename Block>
+void xpby(const Block &x, const Eigen::RowVector3d &beta, Block &y)
+{
+	using scalar = typename Block::Scalar;
+	const scalar *px = x.data();
+	scalar *py = y.data();
+	const int n = 3 * x.rows();
+	const scalar b[3] = { (scalar)beta[0], (scalar)beta[1], (scalar)beta[2] };
+	#pragma omp parallel for if(n >= 3 * parallel_threshold)
+	for(int i = 0; i < n; i += 3)
+	{
+		py[i] = px[i] + b[0] * py[i];
+		py[i + 1] = px[i + 1] + b[1] * py[i + 1];
+		py[i + 2] = px[i + 2] + b[2] * py[i + 2];
+	}
+}
+
+template<typename Scalar, typename Block>
+void symmetric_product(const Eigen::SparseMatrix<Scalar> &A, const Block &x, Block &y)
+{
+	const int *outer = A.outerIndexPtr(), *inner = A.innerIndexPtr();
+	const Scalar *value = A.valuePtr(), *px = x.data();
+	Scalar *py = y.data();
+	const int n = A.outerSize();
+	#pragma omp parallel for schedule(static) if(n >= parallel_threshold)
+	for(int j = 0; j < n; ++j)
+	{
+		Scalar s0 = 0, s1 = 0, s2 = 0;
+		for(int k = outer[j]; k < outer[j + 1]; ++k)
+		{
+			const Scalar *xi = px + 3 * inner[k];
+			s0 += value[k] * xi[0];
+			s1 += value[k] * xi[1];
+			s2 += value[k] * xi[2];
+		}
+		py[3 * j] = s0;
+		py[3 * j + 1] = s1;
+		py[3 * j + 2] = s2;
+	}
+}
+
+template<typename Vector, typename Block>
+void scale_rows(const Vector &d, const Block &r, Block &z)
+{
+	const auto *pr = r.data(), *pd = d.data();
+	auto *pz = z.data();
+	const int n = d.size();
+	#pragma omp parallel for if(n >= parallel_threshold)
+	for(int i = 0; i < n; ++i)
+	{
+		pz[3 * i] = pd[i] * pr[3 * i];
+		pz[3 * i + 1] = pd[i] * pr[3 * i + 1];
+		pz[3 * i + 2] = pd[i] * pr[3 * i + 2];
+	}
+}
+
+}
+
+Eigen::RowVector3d block_dot(const block_t &a, const block_t &b) { return dot(a, b); }
+Eigen::RowVector3d block_dot(const block_f_t &a, const block_f_t &b) { return dot(a, b); }
+void block_axpy(const Eigen::RowVector3d &alpha, const block_t &x, block_t &y) { axpy(alpha, x, y); }
+void block_axpy(const Eigen::RowVector3d &alpha, const block_f_t &x, block_f_t &y) { axpy(alpha, x, y); }
+void block_xpby(const block_t &x, const Eigen::RowVector3d &beta, block_t &y) { xpby(x, beta, y); }
+void block_xpby(const block_f_t &x, const Eigen::RowVector3d &beta, block_f_t &y) { xpby(x, beta, y); }
+
+void sparse_operator_t::apply(const block_t &x, block_t &y) const
+{
+	symmetric_product(A, x, y);
+}
+
+float_sparse_operator_t::float_sparse_operator_t(const Eigen::SparseMatrix<double> &A) : A(A.cast<float>())
+{
+	this->A.makeCompressed();
+}
+
+void float_sparse_operator_t::apply(const block_f_t &x, block_f_t &y) const
+{
+	symmetric_product(A, x, y);
+}
+
+jacobi_preconditioner_t::jacobi_preconditioner_t(const Eigen::VectorXd &diagonal)
+{
+	inv_diag = diagonal;
+	for(Eigen::Index i = 0; i < inv_diag.size(); ++i)
+		inv_diag[i] = inv_diag[i] == 0.0 ? 1.0 : 1.0 / inv_diag[i];
+	inv_diag_f = inv_diag.cast<float>();
+}
+
+void jacobi_preconditioner_t::apply(const block_t &r, block_t &z) const
+{
+	scale_rows(inv_diag, r, z);
+}
+
+void jacobi_preconditioner_t::apply(const block_f_t &r, block_f_t &z) const
+{
+	scale_rows(inv_diag_f, r, z);
+}
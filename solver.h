@@ -0,0 +1,211 @@
+#ifndef __SOLVER_H__
+#define __SOLVER_H__
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <eigen3/Eigen/Sparse>
+#include "block.h"
+
+enum class solver_t
+{
+	automatic,     // picked from the size of the system
+	cg,            // conjugate gradients with a Jacobi preconditioner
+	ichol_cg,      // conjugate gradients with an incomplete Cholesky preconditioner
+	ldlt,          // sparse Cholesky factorizations
+	llt,
+	multigrid,     // multigrid cycles on their own
+	multigrid_cg,  // conjugate gradients preconditioned by one multigrid cycle
+	amg,           // smoothed aggregation multigrid cycles, built from the matrix alone
+	amg_cg,        // conjugate gradients preconditioned by one of those cycles
+	dct,           // direct DCT Poisson solver, full-resolution mode only
+};
+
+struct solver_stats_t
+{
+	int iterations[3];
+	double error[3];    // relative residual |b - Ax| / |b| per channel
+	std::vector<Eigen::RowVector3d> history;  // relative residuals from iteration 0 on
+};
+
+struct multigrid_options_t
+{
+	int pre_smooth = 2, post_smooth = 2;
+	// piecewise-constant transfers undershoot the coarse correction, W-cycles
+	// with over-correction converge as a standalone solver; V-cycles with
+	// correction > 1 are only safe as a CG preconditioner
+	bool w_cycle = true;
+	double correction = 1.5;  // scale of the coarse correction
+	int coarsest = 256;       // largest level solved directly
+};
+
+// column sums of a .* b, accumulated in double for both precisions
+Eigen::RowVector3d block_dot(const block_t &a, const block_t &b);
+Eigen::RowVector3d block_dot(const block_f_t &a, const block_f_t &b);
+
+// y += x * diag(alpha)
+void block_axpy(const Eigen::RowVector3d &alpha, const block_t &x, block_t &y);
+void block_axpy(const Eigen::RowVector3d &alpha, const block_f_t &x, block_f_t &y);
+
+// y = x + y * diag(beta)
+void block_xpby(const block_t &x, const Eigen::RowVector3d &beta, block_t &y);
+void block_xpby(const block_f_t &x, const Eigen::RowVector3d &beta, block_f_t &y);
+
+/*
+ * A symmetric sparse matrix applied to all channels at once: every stored
+ * entry is loaded once per product instead of once per channel. Column j
+ * of a symmetric matrix is also its row j, so the column-major storage is
+ * walked as if it were row-major.
+ */
+class sparse_operator_t
+{
+	const Eigen::SparseMatrix<double> &A;  // compressed
+public:
+	sparse_operator_t(const Eigen::SparseMatrix<double> &A) : A(A) {}
+	int rows() const { return A.rows(); }
+	Eigen::VectorXd diagonal() const { return A.diagonal(); }
+	void apply(const block_t &x, block_t &y) const;
+};
+
+// a copy of a sparse_operator_t matrix in single precision
+class float_sparse_operator_t
+{
+	Eigen::SparseMatrix<float> A;  // compressed
+public:
+	float_sparse_operator_t(const Eigen::SparseMatrix<double> &A);
+	int rows() const { return A.rows(); }
+	Eigen::VectorXd diagonal() const { return A.diagonal().cast<double>(); }
+	void apply(const block_f_t &x, block_f_t &y) const;
+};
+
+class jacobi_preconditioner_t
+{
+	Eigen::VectorXd inv_diag;
+	Eigen::VectorXf inv_diag_f;
+public:
+	jacobi_preconditioner_t(const Eigen::VectorXd &diagonal);
+	void apply(const block_t &r, block_t &z) const;
+	void apply(const block_f_t &r, block_f_t &z) const;
+};
+
+/*
+ * Preconditioned conjugate gradients on the three channels in lockstep,
+ * each channel with its own step lengths, sharing one operator product per
+ * iteration. Stops a channel once |b - Ax| <= tolerance * |b| and starts
+ * from the x passed in. Runs in the precision of the block.
+ */
+template<typename Operator, typename Preconditioner, typename Block>
+solver_stats_t block_cg(const Operator &A, const Preconditioner &M, const Block &b, Block &x,
+	double tolerance, int max_iterations)
+{
+	const int n = A.rows();
+	solver_stats_t stats;
+	Eigen::RowVector3d rhs_norm2 = block_dot(b, b), threshold, residual_norm2;
+	for(int ch = 0; ch < 3; ++ch)
+		threshold[ch] = std::max(tolerance * tolerance * rhs_norm2[ch], std::numeric_limits<double>::min());
+
+	Block r(n, 3), z(n, 3), p(n, 3), q(n, 3);
+	A.apply(x, r);
+	block_xpby(b, Eigen::RowVector3d::Constant(-1.0), r);
+	residual_norm2 = block_dot(r, r);
+
+	bool done[3];
+	auto converged = [&](int it) {
+		bool all = true;
+		stats.history.push_back((residual_norm2.array() / rhs_norm2.array().max(std::numeric_limits<double>::min())).sqrt().matrix());
+		for(int ch = 0; ch < 3; ++ch)
+		{
+			if(!done[ch] && (residual_norm2[ch] < threshold[ch] || rhs_norm2[ch] == 0.0))
+			{
+				done[ch] = true;
+				stats.iterations[ch] = it;
+			}
+			all = all && done[ch];
+		}
+		return all;
+	};
+
+	std::fill(done, done + 3, false);
+	int it = 0;
+	if(!converged(it))
+	{
+		M.apply(r, p);
+		Eigen::RowVector3d abs_new = block_dot(r, p);
+		while(it < max_iterations)
+		{
+			A.apply(p, q);
+			Eigen::RowVector3d pq = block_dot(p, q), alpha;
+			for(int ch = 0; ch < 3; ++ch)
+				alpha[ch] = done[ch] ? 0.0 : abs_new[ch] / pq[ch];
+			block_axpy(alpha, p, x);
+			block_axpy(-alpha, q, r);
+			residual_norm2 = block_dot(r, r);
+			if(converged(++it))
+				break;
+
+			M.apply(r, z);
+			Eigen::RowVector3d abs_old = abs_new, beta;
+			abs_new = block_dot(r, z);
+			for(int ch = 0; ch < 3; ++ch)
+				beta[ch] = done[ch] ? 0.0 : abs_new[ch] / abs_old[ch];
+			block_xpby(z, beta, p);
+		}
+	}
+
+	for(int ch = 0; ch < 3; ++ch)
+	{
+		if(!done[ch])
+			stats.iterations[ch] = it;
+		stats.error[ch] = rhs_norm2[ch] == 0.0 ? 0.0 : std::sqrt(residual_norm2[ch] / rhs_norm2[ch]);
+	}
+
+	return stats;
+}
+
+/*
+ * Preconditioned Richardson iteration x += M(b - Ax), the way a multigrid
+ * cycle is used as a solver of its own. Same stopping rule as block_cg.
+ */
+template<typename Operator, typename Preconditioner, typename Block>
+solver_stats_t block_richardson(const Operator &A, const Preconditioner &M, const Block &b, Block &x,
+	double tolerance, int max_iterations)
+{
+	const int n = A.rows();
+	solver_stats_t stats;
+	Eigen::RowVector3d rhs_norm2 = block_dot(b, b), residual_norm2;
+	Block r(n, 3), z(n, 3);
+	bool done[3] = { false, false, false };
+	for(int it = 0; ; ++it)
+	{
+		A.apply(x, r);
+		block_xpby(b, Eigen::RowVector3d::Constant(-1.0), r);
+		residual_norm2 = block_dot(r, r);
+		stats.history.push_back((residual_norm2.array() / rhs_norm2.array().max(std::numeric_limits<double>::min())).sqrt().matrix());
+
+		bool all = true;
+		for(int ch = 0; ch < 3; ++ch)
+		{
+			if(!done[ch] && (residual_norm2[ch] <= tolerance * tolerance * rhs_norm2[ch] || it == max_iterations))
+			{
+				done[ch] = true;
+				stats.iterations[ch] = it;
+				stats.error[ch] = rhs_norm2[ch] == 0.0 ? 0.0 : std::sqrt(residual_norm2[ch] / rhs_norm2[ch]);
+			}
+			all = all && done[ch];
+		}
+		if(all)
+			break;
+
+		// converged channels keep their x
+		M.apply(r, z);
+		for(int ch = 0; ch < 3; ++ch)
+			if(done[ch])
+				z.col(ch).setZero();
+		block_axpy(Eigen::RowVector3d::Ones(), z, x);
+	}
+
+	return stats;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "sparse_assembly.h"
+#include "parallel.h"
+#include "profile.h"
+#include <algorithm>
+
+namespace
+{
+
+// every thread emits the triplets of its share of [0, n) and sums them into
+// a local matrix, the local matrices are then added pairwise
+template<typename Generate>
+Eigen::SparseMatrix<double> parallel_assemble(int rows, int cols, size_t n, const Generate &generate)
+{
+	int threads = std::max(1, std::min<int>(thread_count(), n / 4096 + 1));
+	std::vector<Eigen::SparseMatrix<double>> part(threads);
+
+	#pragma omp parallel for schedule(static, 1) num_threads(threads)
+	for(int t = 0; t < threads; ++t)
+	{
+		trace_span_t span("assemble share");
+		std::vector<Eigen::Triplet<double>> local;
+		generate(n * t / threads, n * (t + 1) / threads, local);
+		part[t].resize(rows, cols);
+		part[t].setFromTriplets(local.begin(), local.end());
+	}
+
+	for(int step = 1; step < threads; step <<= 1)
+	{
+		#pragma omp parallel for schedule(static, 1) num_threads(threads)
+		for(int t = 0; t < threads - step; t += 2 * step)
+		{
+			trace_span_t span("merge shares");
+			part[t] += part[t + step];
+			part[t + step] = Eigen::SparseMatrix<double>();
+		}
+	}
+
+	return std::move(part[0]);
+}
+
+}
+
+void assemble_normal_matrix(const std::vector<sparse_row_t> &S, int size,
+	const std::vector<Eigen::Triplet<double>> &items, Eigen::SparseMatrix<double> &StS)
+{
+	// rows first, then the extra triplets
+	size_t n = S.size() + items.size();
+	StS = parallel_assemble(size, size, n, [&](size_t l, size_t r, std::vector<Eigen::Triplet<double>> &local) {
+		size_t count = 0;
+		for(size_t i = l; i < r; ++i)
+			count += i < S.size() ? S[i].size() * S[i].size() : 1;
+		local.reserve(count);
+
+		for(size_t i = l; i < r; ++i)
+		{
+			if(i < S.size())
+			{
+				for(auto mv1 : S[i])
+					for(auto mv2 : S[i])
+						local.push_back( { mv1.first, mv2.first, mv1.second * mv2.second } );
+			} else local.push_back(items[i - S.size()]);
+		}
+	} );
+	StS.makeCompressed();
+}
+
+void assemble_normal_vectors(const std::vector<sparse_row_t> &S, int size,
+	const std::vector<double> B[3], block_t &StB)
+{
+	// B is zero away from the seams, so the products are collected sparsely
+	Eigen::SparseMatrix<double, Eigen::RowMajor> M = parallel_assemble(size, 3, S.size(),
+		[&](size_t l, size_t r, std::vector<Eigen::Triplet<double>> &local) {
+			for(size_t i = l; i < r; ++i)
+				for(int ch = 0; ch < 3; ++ch)
+					if(B[ch][i] != 0.0)
+						for(auto mv : S[i])
+							local.push_back( { mv.first, ch, mv.second * B[ch][i] } );
+		} );
+
+	StB = M;
+}
@@ -0,0 +1,26 @@
+#ifndef __SPARSE_ASSEMBLY_H__
+#define __SPARSE_ASSEMBLY_H__
+
+#include <utility>
+#include <vector>
+#include <eigen3/Eigen/Sparse>
+#include "block.h"
+
+using sparse_row_t = std::vector<std::pair<int, double>>;
+
+/*
+ * Normal equations of a sparse least squares system S x = B.
+ *
+ * The rows of S are split into one contiguous block per thread. Every
+ * thread turns its block (and its share of the extra triplets) into a
+ * local sparse matrix, Eigen sums the duplicates while doing so, and the
+ * local matrices are added pairwise into the result.
+ */
+void assemble_normal_matrix(const std::vector<sparse_row_t> &S, int size,
+	const std::vector<Eigen::Triplet<double>> &items, Eigen::SparseMatrix<double> &StS);
+
+// column ch of StB is S^T B[ch], assembled the same way
+void assemble_normal_vectors(const std::vector<sparse_row_t> &S, int size,
+	const std::vector<double> B[3], block_t &StB);
+
+#endif
@@ -0,0 +1,289 @@
+#include "sparse_multigrid.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+
+double seconds_since(std::chrono::steady_clock::time_point t)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+// P(i, aggregate[i]) = 1, minus omega D^-1 A P if A is given
+Eigen::SparseMatrix<double> prolongation(const std::vector<int> &aggregate,
+	const Eigen::SparseMatrix<double> *A = nullptr, double omega = 0.0)
+{
+	int n = aggregate.size();
+	int m = *std::max_element(aggregate.begin(), aggregate.end()) + 1;
+	std::vector<Eigen::Triplet<double>> items;
+	items.reserve(A ? A->nonZeros() + n : n);
+	for(int i = 0; i < n; ++i)
+		items.emplace_back(i, aggregate[i], 1.0);
+	if(A)
+	{
+		// column i of the symmetric A is its row i
+		Eigen::VectorXd d = A->diagonal();
+		for(int i = 0; i < n; ++i)
+			for(Eigen::SparseMatrix<double>::InnerIterator it(*A, i); it; ++it)
+				items.emplace_back(i, aggregate[it.row()], -omega * it.value() / d[i]);
+	}
+
+	Eigen::SparseMatrix<double> P(n, m);
+	P.setFromTriplets(items.begin(), items.end());
+	P.prune(0.0);
+	return P;
+}
+
+/*
+ * Greedy aggregation on the strong connections |a_ij| >= theta sqrt(a_ii a_jj).
+ * A node whose strong neighbours are all free starts an aggregate with them,
+ * the nodes left over join the aggregate they are most strongly connected
+ * to, and whatever is still free groups with its free neighbours.
+ */
+std::vector<int> strong_aggregates(const Eigen::SparseMatrix<double> &A, double theta)
+{
+	const int n = A.rows();
+	Eigen::VectorXd d = A.diagonal();
+	auto strong = [&](int i, int j, double a) {
+		return i != j && a * a >= theta * theta * d[i] * d[j];
+	};
+
+	std::vector<int> aggregate(n, -1);
+	int count = 0;
+	for(int i = 0; i < n; ++i)
+	{
+		bool free = true;
+		for(Eigen::SparseMatrix<double>::InnerIterator it(A, i); it && free; ++it)
+			if(strong(i, it.row(), it.value()) && aggregate[it.row()] >= 0)
+				free = false;
+		if(!free)
+			continue;
+		aggregate[i] = count;
+		for(Eigen::SparseMatrix<double>::InnerIterator it(A, i); it; ++it)
+			if(strong(i, it.row(), it.value()))
+				aggregate[it.row()] = count;
+		++count;
+	}
+
+	std::vector<int> joined = aggregate;
+	for(int i = 0; i < n; ++i)
+	{
+		if(aggregate[i] >= 0)
+			continue;
+		double best = 0.0;
+		for(Eigen::SparseMatrix<double>::InnerIterator it(A, i); it; ++it)
+		{
+			int j = it.row();
+			if(aggregate[j] >= 0 && strong(i, j, it.value()) && std::abs(it.value()) > best)
+				best = std::abs(it.value()), joined[i] = aggregate[j];
+		}
+	}
+
+	for(int i = 0; i < n; ++i)
+	{
+		if(joined[i] >= 0)
+			continue;
+		joined[i] = count;
+		for(Eigen::SparseMatrix<double>::InnerIterator it(A, i); it; ++it)
+			if(joined[it.row()] < 0 && strong(i, it.row(), it.value()))
+				joined[it.row()] = count;
+		++count;
+	}
+
+	return joined;
+}
+
+// largest eigenvalue of D^-1 A by power iteration
+double jacobi_spectral_radius(const Eigen::SparseMatrix<double> &A, const Eigen::VectorXd &inv_diag)
+{
+	Eigen::VectorXd v = Eigen::VectorXd::Ones(A.rows()), w;
+	v[0] = 2.0;  // not the null vector of a pure Laplacian
+	double rho = 1.0;
+	for(int it = 0; it < 15; ++it)
+	{
+		w = inv_diag.asDiagonal() * (A * v);
+		rho = w.norm() / v.norm();
+		v = w / w.norm();
+	}
+	return rho;
+}
+
+}
+
+sparse_multigrid_t::sparse_multigrid_t(const Eigen::SparseMatrix<double> &A,
+	const std::vector<std::vector<int>> &aggregates, const multigrid_options_t &options)
+	: options(options)
+{
+	levels.emplace_back();
+	levels.back().A = A;
+	levels.back().A.makeCompressed();
+
+	for(const std::vector<int> &aggregate : aggregates)
+	{
+		if(levels.back().A.rows() <= options.coarsest)
+			break;
+		add_level(prolongation(aggregate));
+	}
+
+	finish();
+}
+
+sparse_multigrid_t::sparse_multigrid_t(const Eigen::SparseMatrix<double> &A, const multigrid_options_t &options)
+	: options(options)
+{
+	levels.emplace_back();
+	levels.back().A = A;
+	levels.back().A.makeCompressed();
+
+	double theta = 0.08;
+	while(levels.back().A.rows() > options.coarsest)
+	{
+		const Eigen::SparseMatrix<double> &F = levels.back().A;
+		std::vector<int> aggregate = strong_aggregates(F, theta);
+		if(*std::max_element(aggregate.begin(), aggregate.end()) + 1 == F.rows())
+			break;
+
+		// P = (I - omega D^-1 A) T for the piecewise-constant T, omega = 4 / (3 rho(D^-1 A))
+		double omega = 4.0 / (3.0 * jacobi_spectral_radius(F, F.diagonal().cwiseInverse()));
+		Eigen::SparseMatrix<double> P = prolongation(aggregate, &F, omega);
+		add_level(P);
+		theta /= 2.0;
+	}
+
+	finish();
+}
+
+void sparse_multigrid_t::add_level(const Eigen::SparseMatrix<double> &P)
+{
+	level_t &f = levels.back();
+	f.P = P;
+	f.P.makeCompressed();
+
+	level_t c;
+	c.A = Eigen::SparseMatrix<double>(f.P.transpose()) * f.A * f.P;
+	c.A.prune(0.0);
+	c.A.makeCompressed();
+	levels.push_back(std::move(c));
+}
+
+void sparse_multigrid_t::finish()
+{
+	for(level_t &l : levels)
+	{
+		int n = l.A.rows();
+		l.x.resize(n, 3);
+		l.b.resize(n, 3);
+		l.r.resize(n, 3);
+		l.stats = { n, (int)l.A.nonZeros(), 0, 0.0, 0.0 };
+		l.smoothing_sum = 0.0;
+		l.smoothing_count = 0;
+	}
+
+	coarse.compute(Eigen::MatrixXd(levels.back().A));
+}
+
+void sparse_multigrid_t::residual(const level_t &l, block_t &r)
+{
+	// column j of the symmetric matrix is its row j
+	const int n = l.A.rows();
+	const int *outer = l.A.outerIndexPtr(), *inner = l.A.innerIndexPtr();
+	const double *value = l.A.valuePtr();
+	#pragma omp parallel for if(n >= parallel_threshold)
+	for(int i = 0; i < n; ++i)
+	{
+		Eigen::RowVector3d sum = l.b.row(i);
+		for(int k = outer[i]; k < outer[i + 1]; ++k)
+			sum -= value[k] * l.x.row(inner[k]);
+		r.row(i) = sum;
+	}
+}
+
+void sparse_multigrid_t::smooth(level_t &l, int sweeps, bool reverse)
+{
+	const int n = l.A.rows();
+	const int *outer = l.A.outerIndexPtr(), *inner = l.A.innerIndexPtr();
+	const double *value = l.A.valuePtr();
+	for(int s = 0; s < sweeps; ++s)
+	{
+		for(int t = 0; t < n; ++t)
+		{
+			int i = reverse ? n - 1 - t : t;
+			Eigen::RowVector3d sum = l.b.row(i);
+			double diag = 0.0;
+			for(int k = outer[i]; k < outer[i + 1]; ++k)
+			{
+				if(inner[k] == i) diag += value[k];
+				else sum -= value[k] * l.x.row(inner[k]);
+			}
+			if(diag != 0.0)
+				l.x.row(i) = sum / diag;
+		}
+	}
+}
+
+void sparse_multigrid_t::cycle(int k) const
+{
+	level_t &l = levels[k];
+	if(k + 1 == (int)levels.size())
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		l.x = coarse.solve(l.b);
+		l.stats.visits++;
+		l.stats.seconds += seconds_since(t0);
+		return;
+	}
+
+	level_t &c = levels[k + 1];
+	auto t0 = std::chrono::steady_clock::now();
+	double before = l.x.isZero(0.0) ? l.b.norm() : -1.0;
+	smooth(l, options.pre_smooth, false);
+	residual(l, l.r);
+	if(before > 0.0)
+		l.smoothing_sum += l.r.norm() / before, l.smoothing_count++;
+	l.stats.visits++;
+	c.b.noalias() = l.P.transpose() * l.r;
+	c.x.setZero();
+	l.stats.seconds += seconds_since(t0);
+
+	for(int g = 0; g < (options.w_cycle ? 2 : 1); ++g)
+		cycle(k + 1);
+
+	t0 = std::chrono::steady_clock::now();
+	l.x.noalias() += options.correction * (l.P * c.x);
+	smooth(l, options.post_smooth, true);
+	l.stats.seconds += seconds_since(t0);
+}
+
+void sparse_multigrid_t::apply(const block_t &r, block_t &z) const
+{
+	levels[0].b = r;
+	levels[0].x.setZero();
+	cycle(0);
+	z = levels[0].x;
+}
+
+std::vector<sparse_multigrid_t::level_stats_t> sparse_multigrid_t::level_stats() const
+{
+	std::vector<level_stats_t> stats;
+	for(const level_t &l : levels)
+	{
+		stats.push_back(l.stats);
+		if(l.smoothing_count > 0)
+			stats.back().smoothing_factor = l.smoothing_sum / l.smoothing_count;
+	}
+	return stats;
+}
+
+void sparse_multigrid_t::reset_stats() const
+{
+	for(level_t &l : levels)
+	{
+		l.stats.visits = 0;
+		l.stats.seconds = 0.0;
+		l.smoothing_sum = 0.0;
+		l.smoothing_count = 0;
+	}
+}
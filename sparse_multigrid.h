@@ -0,0 +1,70 @@
+#ifndef __SPARSE_MULTIGRID_H__
+#define __SPARSE_MULTIGRID_H__
+
+#include <vector>
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Sparse>
+#include "block.h"
+#include "solver.h"
+
+/*
+ * Multigrid on a symmetric sparse matrix with coarse spaces built from
+ * aggregates: every unknown of a level belongs to one unknown of the next
+ * coarser level. The aggregates are either given, and the prolongation P
+ * copies the coarse value to the members of an aggregate, or found from the
+ * strong connections of the matrix alone (smoothed aggregation), and P is
+ * that copy smoothed by one damped Jacobi step. The restriction is P^T and
+ * the coarse matrix the Galerkin product P^T A P. Gauss-Seidel smooths
+ * forward before and backward after the coarse correction, so a cycle is
+ * symmetric and can precondition CG. The coarsest level is solved densely.
+ */
+class sparse_multigrid_t
+{
+public:
+	struct level_stats_t
+	{
+		int rows, nonzeros;
+		int visits;
+		double seconds;           // smoothing, residual and transfers on this level
+		double smoothing_factor;  // mean |r| after / before pre-smoothing from x = 0
+	};
+
+private:
+	struct level_t
+	{
+		Eigen::SparseMatrix<double> A;  // compressed, both triangles
+		Eigen::SparseMatrix<double> P;  // from the next level, empty on the coarsest
+		block_t x, b, r;
+		level_stats_t stats;
+		double smoothing_sum;
+		int smoothing_count;
+	};
+
+	multigrid_options_t options;
+	mutable std::vector<level_t> levels;
+	Eigen::LLT<Eigen::MatrixXd> coarse;
+
+	void add_level(const Eigen::SparseMatrix<double> &P);
+	void finish();
+	static void residual(const level_t &l, block_t &r);
+	static void smooth(level_t &l, int sweeps, bool reverse);
+	void cycle(int k) const;
+public:
+	// aggregates[k][i] is the unknown on level k + 1 of unknown i on level k,
+	// levels stop early once one has at most options.coarsest unknowns
+	sparse_multigrid_t(const Eigen::SparseMatrix<double> &A, const std::vector<std::vector<int>> &aggregates,
+		const multigrid_options_t &options);
+	// smoothed aggregation, the hierarchy is built from the entries of A only
+	sparse_multigrid_t(const Eigen::SparseMatrix<double> &A, const multigrid_options_t &options);
+
+	int rows() const { return levels[0].A.rows(); }
+	int level_count() const { return levels.size(); }
+
+	// one cycle on A z = r from z = 0, the preconditioner interface of block_cg
+	void apply(const block_t &r, block_t &z) const;
+
+	std::vector<level_stats_t> level_stats() const;
+	void reset_stats() const;
+};
+
+#endif